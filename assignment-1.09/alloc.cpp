@@ -0,0 +1,207 @@
+#ifdef OPAL_ALLOCS
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+#include "alloc.h"
+
+/* glibc's own entry points, under the names they are interposed on */
+extern "C" {
+void	*__libc_malloc(std::size_t);
+void	*__libc_calloc(std::size_t, std::size_t);
+void	*__libc_realloc(void *, std::size_t);
+void	__libc_free(void *);
+}
+
+static void	count(std::size_t const);
+static bool	steady(int const);
+
+static char const *const phase_names[ALLOC_PHASES] = {
+	"other",
+	"parse",
+	"gen",
+	"spawn",
+	"dijkstra",
+	"npc turn",
+	"render",
+	"menu",
+	"save"
+};
+
+static thread_local alloc_phase phase = ALLOC_OTHER;
+
+static std::atomic<uint64_t> counts[ALLOC_PHASES];
+static std::atomic<uint64_t> bytes[ALLOC_PHASES];
+
+/* PC turns, only touched by the engine thread */
+static uint64_t turn_start[ALLOC_PHASES];
+static bool turn_open;
+static int turn_settle = 1; /* turns still to end before steady state */
+static uint64_t turns;
+static uint64_t steady_turns;
+static uint64_t bad_turns;
+static uint64_t max_allocs;
+static uint64_t first_bad;
+static uint64_t first_bad_counts[ALLOC_PHASES];
+
+extern "C" void *
+malloc(std::size_t size) noexcept
+{
+	count(size);
+
+	return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(std::size_t n, std::size_t size) noexcept
+{
+	count(n * size);
+
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *
+realloc(void *p, std::size_t size) noexcept
+{
+	count(size);
+
+	return __libc_realloc(p, size);
+}
+
+extern "C" void
+free(void *p) noexcept
+{
+	__libc_free(p);
+}
+
+alloc_scope::alloc_scope(alloc_phase const p) : prev(phase)
+{
+	phase = p;
+}
+
+alloc_scope::~alloc_scope()
+{
+	phase = prev;
+}
+
+/* neither the turn in progress nor the first on the new floor is steady */
+void
+alloc_new_floor()
+{
+	turn_settle = 2;
+}
+
+/* ends the previous PC turn and starts the next */
+void
+alloc_pc_turn()
+{
+	uint64_t now[ALLOC_PHASES];
+	uint64_t n = 0;
+
+	for (int i = 0; i < ALLOC_PHASES; ++i) {
+		now[i] = counts[i].load(std::memory_order_relaxed);
+
+		if (steady(i)) {
+			n += now[i] - turn_start[i];
+		}
+	}
+
+	if (turn_open) {
+		turns++;
+		max_allocs = std::max(max_allocs, n);
+
+		if (turn_settle > 0) {
+			turn_settle--;
+		} else {
+			steady_turns++;
+
+			if (n != 0 && bad_turns++ == 0) {
+				first_bad = turns;
+
+				for (int i = 0; i < ALLOC_PHASES; ++i) {
+					first_bad_counts[i] = now[i]
+						- turn_start[i];
+				}
+			}
+		}
+	}
+
+	std::copy(now, now + ALLOC_PHASES, turn_start);
+	turn_open = true;
+}
+
+/* false if a steady-state turn allocated */
+bool
+alloc_report(std::ostream &os)
+{
+	char buf[80];
+
+	(void)snprintf(buf, sizeof(buf), "%-30s %12s %12s\n",
+		"allocations by phase", "count", "bytes");
+	os << buf;
+
+	for (int i = 0; i < ALLOC_PHASES; ++i) {
+		(void)snprintf(buf, sizeof(buf), "  %-28s %12" PRIu64
+			" %12" PRIu64 "\n", phase_names[i],
+			counts[i].load(std::memory_order_relaxed),
+			bytes[i].load(std::memory_order_relaxed));
+		os << buf;
+	}
+
+	std::pair<char const *, uint64_t> const totals[] = {
+		{ "pc turns", turns },
+		{ "steady-state turns", steady_turns },
+		{ "steady-state turns allocating", bad_turns },
+		{ "most allocations in a turn", max_allocs }
+	};
+
+	for (auto const &t : totals) {
+		(void)snprintf(buf, sizeof(buf), "%-30s %12" PRIu64 "\n",
+			t.first, t.second);
+		os << buf;
+	}
+
+	if (bad_turns == 0) {
+		return true;
+	}
+
+	(void)snprintf(buf, sizeof(buf), "first allocating turn %" PRIu64
+		":\n", first_bad);
+	os << buf;
+
+	for (int i = 0; i < ALLOC_PHASES; ++i) {
+		if (!steady(i) || first_bad_counts[i] == 0) {
+			continue;
+		}
+
+		(void)snprintf(buf, sizeof(buf), "  %-28s %12" PRIu64 "\n",
+			phase_names[i], first_bad_counts[i]);
+		os << buf;
+	}
+
+	return false;
+}
+
+/*
+ * Menus build strings, floors are built ahead on another thread, and
+ * quick-saves and the snapshot ring copy the game out, the ring into
+ * buffers that stop growing once it has gone round.
+ */
+static bool
+steady(int const p)
+{
+	return p != ALLOC_MENU && p != ALLOC_GEN && p != ALLOC_SAVE;
+}
+
+static void
+count(std::size_t const size)
+{
+	counts[phase].fetch_add(1, std::memory_order_relaxed);
+	bytes[phase].fetch_add(size, std::memory_order_relaxed);
+}
+
+#endif /* OPAL_ALLOCS */
@@ -0,0 +1,70 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <ostream>
+
+/*
+ * Heap allocation accounting, compiled in only with -DOPAL_ALLOCS (make
+ * allocs). malloc, calloc, realloc and so operator new are counted against
+ * the calling thread's innermost ALLOC_PHASE, and alloc_pc_turn() cuts the
+ * counts into PC turns. Steady-state turns, all but the first on a floor
+ * and the one taking the stairs, should allocate nothing outside of menus
+ * and floor generation, which runs ahead on its own thread.
+ */
+enum alloc_phase {
+	ALLOC_OTHER,
+	ALLOC_PARSE,
+	ALLOC_GEN,
+	ALLOC_SPAWN,
+	ALLOC_DIJKSTRA,
+	ALLOC_NPC,
+	ALLOC_RENDER,
+	ALLOC_MENU,
+	ALLOC_SAVE,
+	ALLOC_PHASES
+};
+
+#ifdef OPAL_ALLOCS
+
+class alloc_scope {
+	alloc_phase	prev;
+public:
+	explicit alloc_scope(alloc_phase const);
+	~alloc_scope();
+
+	alloc_scope(alloc_scope const &) = delete;
+	alloc_scope	&operator=(alloc_scope const &) = delete;
+};
+
+#define ALLOC_CAT2(a, b)	a##b
+#define ALLOC_CAT(a, b)		ALLOC_CAT2(a, b)
+#define ALLOC_PHASE(p)		alloc_scope const ALLOC_CAT(alloc_, __LINE__)(p)
+
+void	alloc_new_floor();
+void	alloc_pc_turn();
+bool	alloc_report(std::ostream &);
+
+#else
+
+#define ALLOC_PHASE(p)
+
+static inline void
+alloc_new_floor()
+{
+}
+
+static inline void
+alloc_pc_turn()
+{
+}
+
+static inline bool
+alloc_report(std::ostream &os)
+{
+	os << "allocations: not tracked, build with 'make allocs'\n";
+	return true;
+}
+
+#endif /* OPAL_ALLOCS */
+
+#endif /* ALLOC_H */
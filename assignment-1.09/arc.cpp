@@ -0,0 +1,199 @@
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#include <endian.h>
+#undef _BSD_SOURCE
+#undef _DEFAULT_SOURCE
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arc.h"
+#include "cerr.h"
+#include "lz.h"
+
+static bool	read_floor(uint8_t const *, std::size_t const, uint64_t const,
+	std::vector<uint8_t> &);
+
+static char const MAGIC[8] = { 'O', 'P', 'A', 'L', 'A', 'R', 'C', '1' };
+
+static std::size_t constexpr HEADER_SIZE = sizeof(MAGIC) + 8;
+static std::size_t constexpr ENTRY_SIZE = 8 + 4 + 4;
+
+static FILE *arc;
+static std::vector<uint8_t> entries; /* the index */
+static uint64_t count;
+static uint64_t added;
+static uint64_t offset;
+
+void
+arc_open(std::string const &path, uint64_t const n)
+{
+	uint8_t hdr[HEADER_SIZE];
+	uint64_t const be = htobe64(n);
+
+	if ((arc = fopen(path.c_str(), "wb")) == NULL) {
+		cerr(1, "archive fopen %s", path.c_str());
+	}
+
+	count = n;
+	added = 0;
+	offset = HEADER_SIZE + n * ENTRY_SIZE;
+
+	entries.assign(n * ENTRY_SIZE, 0);
+
+	(void)memcpy(hdr, MAGIC, sizeof(MAGIC));
+	(void)memcpy(hdr + 8, &be, 8);
+
+	/* the index is all zeroes until arc_close() */
+	if (fwrite(hdr, sizeof(hdr), 1, arc) != 1 || (n != 0
+		&& fwrite(entries.data(), entries.size(), 1, arc) != 1)) {
+		cerr(1, "archive header fwrite");
+	}
+}
+
+/* a floor stored in size bytes, raw once unpacked */
+void
+arc_add(uint8_t const *const floor, std::size_t const size,
+	std::size_t const raw)
+{
+	uint8_t *const e = entries.data() + added * ENTRY_SIZE;
+	uint64_t const off = htobe64(offset);
+	uint32_t const sz = htobe32((uint32_t)size);
+	uint32_t const rsz = htobe32((uint32_t)raw);
+
+	if (added == count) {
+		cerrx(1, "archive holds only %lu floors", (unsigned long)count);
+	}
+
+	if (fwrite(floor, size, 1, arc) != 1) {
+		cerr(1, "archive fwrite");
+	}
+
+	(void)memcpy(e, &off, 8);
+	(void)memcpy(e + 8, &sz, 4);
+	(void)memcpy(e + 12, &rsz, 4);
+
+	offset += size;
+	added++;
+}
+
+void
+arc_close()
+{
+	if (arc == NULL) {
+		return;
+	}
+
+	if (added != count) {
+		cerrx(1, "archive has %lu of %lu floors", (unsigned long)added,
+			(unsigned long)count);
+	}
+
+	if (fseek(arc, HEADER_SIZE, SEEK_SET) == -1) {
+		cerr(1, "archive fseek");
+	}
+
+	if (count != 0
+		&& fwrite(entries.data(), entries.size(), 1, arc) != 1) {
+		cerr(1, "archive index fwrite");
+	}
+
+	if (fclose(arc) == EOF) {
+		cerr(1, "archive fclose");
+	}
+
+	arc = NULL;
+}
+
+/*
+ * Only the header, the floor's index entry and the floor itself are paged
+ * in from the mapping, however many floors the archive holds.
+ */
+bool
+arc_read(std::string const &path, uint64_t const i, std::vector<uint8_t> &out)
+{
+	struct stat st;
+	int fd;
+	bool ret = false;
+
+	if ((fd = open(path.c_str(), O_RDONLY)) == -1) {
+		cerr(1, "archive open %s", path.c_str());
+	}
+
+	if (fstat(fd, &st) == -1) {
+		cerr(1, "archive fstat %s", path.c_str());
+	}
+
+	if (st.st_size > 0) {
+		std::size_t const size = (std::size_t)st.st_size;
+		void *const m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (m == MAP_FAILED) {
+			cerr(1, "archive mmap %s", path.c_str());
+		}
+
+		ret = read_floor(static_cast<uint8_t const *>(m), size, i, out);
+
+		if (munmap(m, size) == -1) {
+			cerr(1, "archive munmap %s", path.c_str());
+		}
+	}
+
+	if (close(fd) == -1) {
+		cerr(1, "archive close %s", path.c_str());
+	}
+
+	return ret;
+}
+
+static bool
+read_floor(uint8_t const *const p, std::size_t const size, uint64_t const i,
+	std::vector<uint8_t> &out)
+{
+	uint64_t n;
+	uint64_t off;
+	uint32_t sz;
+	uint32_t rsz;
+
+	if (size < HEADER_SIZE || memcmp(p, MAGIC, sizeof(MAGIC)) != 0) {
+		return false;
+	}
+
+	(void)memcpy(&n, p + 8, 8);
+	n = be64toh(n);
+
+	if (i >= n || n > (size - HEADER_SIZE) / ENTRY_SIZE) {
+		return false;
+	}
+
+	uint8_t const *const e = p + HEADER_SIZE + i * ENTRY_SIZE;
+
+	(void)memcpy(&off, e, 8);
+	(void)memcpy(&sz, e + 8, 4);
+	(void)memcpy(&rsz, e + 12, 4);
+
+	off = be64toh(off);
+	sz = be32toh(sz);
+	rsz = be32toh(rsz);
+
+	if (off < HEADER_SIZE + n * ENTRY_SIZE || off > size
+		|| sz > size - off || sz > rsz) {
+		return false;
+	}
+
+	out.clear();
+
+	if (sz == rsz) {
+		out.assign(p + off, p + off + sz);
+
+		return true;
+	}
+
+	return lz_unpack(out, p + off, sz, rsz) && out.size() == rsz;
+}
@@ -0,0 +1,23 @@
+#ifndef ARC_H
+#define ARC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Many RLG327 floors in one file: an 8 byte magic and big-endian floor
+ * count, an index entry per floor of its offset, stored size and size
+ * unpacked, then the floors back to back. A floor stored smaller than it
+ * unpacks is lz_pack()ed. Floors are added in order; the index is filled
+ * in by arc_close().
+ */
+void	arc_open(std::string const &, uint64_t const);
+void	arc_add(uint8_t const *, std::size_t const, std::size_t const);
+void	arc_close();
+
+/* floor i of an archive, unpacked; false if there is none or it's bad */
+bool	arc_read(std::string const &, uint64_t const, std::vector<uint8_t> &);
+
+#endif /* ARC_H */
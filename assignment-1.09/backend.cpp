@@ -0,0 +1,175 @@
+#include <cerrno>
+
+#include <ncurses.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "backend.h"
+
+static int	read_byte(int const, int const);
+static int	csi_key(int const);
+
+/* how long to wait for the rest of an escape sequence */
+static int constexpr ESC_WAIT_MS = 25;
+static int constexpr KEY_ESC = 27;
+
+/* no output, keys from stdin; for profiling and batch runs without a TTY */
+class null_backend : public backend {
+public:
+	void
+	put(int const, int const, uint32_t const, int const) override
+	{
+	}
+
+	void
+	present() override
+	{
+	}
+
+	int
+	get_key() override
+	{
+		return read_key(STDIN_FILENO);
+	}
+};
+
+std::unique_ptr<backend>
+backend_new(std::string const &name)
+{
+	if (name == "curses") {
+		return backend_curses();
+	} else if (name == "ansi") {
+		return backend_ansi();
+	} else if (name == "null") {
+		return backend_null();
+	}
+
+	return nullptr;
+}
+
+std::unique_ptr<backend>
+backend_null()
+{
+	return std::make_unique<null_backend>();
+}
+
+/*
+ * Read one key from a raw-mode terminal or a pipe, decoding the VT100 and
+ * xterm cursor sequences into the KEY_* codes ncurses keypad mode returns.
+ */
+int
+read_key(int const fd)
+{
+	int const c = read_byte(fd, -1);
+
+	if (c != KEY_ESC) {
+		return c;
+	}
+
+	int const c1 = read_byte(fd, ESC_WAIT_MS);
+
+	if (c1 == ERR) {
+		return KEY_ESC;
+	}
+
+	if (c1 == 'O') {
+		switch (read_byte(fd, ESC_WAIT_MS)) {
+		case 'A':
+			return KEY_UP;
+		case 'B':
+			return KEY_DOWN;
+		case 'C':
+			return KEY_RIGHT;
+		case 'D':
+			return KEY_LEFT;
+		case 'E':
+			return KEY_B2;
+		case 'F':
+			return KEY_END;
+		case 'H':
+			return KEY_HOME;
+		default:
+			return KEY_ESC;
+		}
+	}
+
+	if (c1 == '[') {
+		return csi_key(fd);
+	}
+
+	return KEY_ESC;
+}
+
+/* returns ERR on end of input, or on timeout when wait_ms >= 0 */
+static int
+read_byte(int const fd, int const wait_ms)
+{
+	unsigned char c;
+
+	if (wait_ms >= 0) {
+		struct pollfd p = { fd, POLLIN, 0 };
+
+		if (poll(&p, 1, wait_ms) <= 0) {
+			return ERR;
+		}
+	}
+
+	while (1) {
+		ssize_t const n = read(fd, &c, 1);
+
+		if (n == 1) {
+			return c;
+		}
+
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+
+		return ERR;
+	}
+}
+
+static int
+csi_key(int const fd)
+{
+	int num = 0;
+	int c;
+
+	while ((c = read_byte(fd, ESC_WAIT_MS)) >= '0' && c <= '9') {
+		num = num * 10 + (c - '0');
+	}
+
+	switch (c) {
+	case 'A':
+		return KEY_UP;
+	case 'B':
+		return KEY_DOWN;
+	case 'C':
+		return KEY_RIGHT;
+	case 'D':
+		return KEY_LEFT;
+	case 'E':
+		return KEY_B2;
+	case 'F':
+		return KEY_END;
+	case 'H':
+		return KEY_HOME;
+	case '~':
+		switch (num) {
+		case 1:
+		case 7:
+			return KEY_HOME;
+		case 4:
+		case 8:
+			return KEY_END;
+		case 5:
+			return KEY_PPAGE;
+		case 6:
+			return KEY_NPAGE;
+		default:
+			return KEY_ESC;
+		}
+	default:
+		return KEY_ESC;
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * Output and keyboard input behind the framebuffer. put() is only called for
+ * cells that changed since the last frame, and present() ends the frame.
+ * get_key() returns chars or ncurses KEY_* codes, or ERR.
+ */
+class backend {
+public:
+	virtual ~backend() = default;
+
+	virtual void	put(int const, int const, uint32_t const, int const) = 0;
+	virtual void	present() = 0;
+	virtual int	get_key() = 0;
+};
+
+std::unique_ptr<backend>	backend_new(std::string const &);
+
+std::unique_ptr<backend>	backend_ansi();
+std::unique_ptr<backend>	backend_curses();
+std::unique_ptr<backend>	backend_null();
+
+int	read_key(int const);
+
+#endif /* BACKEND_H */
@@ -0,0 +1,179 @@
+#include <cerrno>
+#include <cstdio>
+#include <string>
+
+#include <ncurses.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "cerr.h"
+#include "globs.h"
+#include "render.h"
+
+static char	dec_graphic(uint32_t const);
+
+/* a cursor move, color, charset switch and glyph */
+static std::size_t constexpr CELL_MAX = 22;
+
+/*
+ * Raw ANSI escape sequences straight to stdout. A frame is assembled in one
+ * buffer and sent with a single write(), which suits slow links. Colors are
+ * ncurses COLOR_PAIR values whose pair number equals the ANSI color.
+ */
+class ansi_backend : public backend {
+	struct termios	saved;
+	std::string	frame;
+
+	/* terminal state as of the end of the buffered output */
+	int	cur_y = -1;
+	int	cur_x = -1;
+	int	cur_color = -1;
+	bool	cur_graphic = false;
+
+	void	send(std::string const &);
+public:
+	ansi_backend();
+	~ansi_backend() override;
+
+	void	put(int const, int const, uint32_t const, int const) override;
+	void	present() override;
+
+	int
+	get_key() override
+	{
+		return read_key(STDIN_FILENO);
+	}
+};
+
+ansi_backend::ansi_backend()
+{
+	struct termios t;
+
+	if (tcgetattr(STDIN_FILENO, &saved) == -1) {
+		cerr(1, "ansi tcgetattr");
+	}
+
+	t = saved;
+	cfmakeraw(&t);
+
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &t) == -1) {
+		cerr(1, "ansi tcsetattr");
+	}
+
+	/* a full frame never grows it, so drawing does not allocate */
+	frame.reserve(HEIGHT * WIDTH * CELL_MAX);
+
+	/* alternate screen, hide cursor, clear */
+	send("\x1b[?1049h\x1b[?25l\x1b[0m\x1b[2J");
+}
+
+ansi_backend::~ansi_backend()
+{
+	send("\x1b[0m\x1b(B\x1b[?25h\x1b[?1049l");
+
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved) == -1) {
+		cerr(1, "ansi tcsetattr restore");
+	}
+}
+
+void
+ansi_backend::put(int const y, int const x, uint32_t const g,
+	int const color)
+{
+	char buf[32];
+	char const graphic = dec_graphic(g);
+
+	if (y != cur_y || x != cur_x) {
+		(void)snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+		frame += buf;
+	}
+
+	if (color != cur_color) {
+		int const pair = PAIR_NUMBER(color);
+
+		if (pair == 0) {
+			frame += "\x1b[0m";
+		} else {
+			(void)snprintf(buf, sizeof(buf), "\x1b[0;%d;40m",
+				30 + pair);
+			frame += buf;
+		}
+
+		cur_color = color;
+	}
+
+	if ((graphic != '\0') != cur_graphic) {
+		cur_graphic = graphic != '\0';
+		frame += cur_graphic ? "\x1b(0" : "\x1b(B";
+	}
+
+	frame += graphic != '\0' ? graphic : static_cast<char>(g);
+
+	cur_y = y;
+	cur_x = x + 1;
+}
+
+void
+ansi_backend::present()
+{
+	send(frame);
+	frame.clear();
+}
+
+void
+ansi_backend::send(std::string const &s)
+{
+	std::size_t off = 0;
+
+	while (off < s.size()) {
+		ssize_t const n = write(STDOUT_FILENO, s.data() + off,
+			s.size() - off);
+
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			cerr(1, "ansi write");
+		}
+
+		off += static_cast<std::size_t>(n);
+	}
+}
+
+std::unique_ptr<backend>
+backend_ansi()
+{
+	return std::make_unique<ansi_backend>();
+}
+
+/* DEC special graphics character for a line glyph, or '\0' */
+static char
+dec_graphic(uint32_t const g)
+{
+	switch (g) {
+	case G_VLINE:
+		return 'x';
+	case G_HLINE:
+		return 'q';
+	case G_ULCORNER:
+		return 'l';
+	case G_URCORNER:
+		return 'k';
+	case G_LLCORNER:
+		return 'm';
+	case G_LRCORNER:
+		return 'j';
+	case G_LTEE:
+		return 't';
+	case G_RTEE:
+		return 'u';
+	case G_TTEE:
+		return 'w';
+	case G_BTEE:
+		return 'v';
+	default:
+		return '\0';
+	}
+}
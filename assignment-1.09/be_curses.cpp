@@ -0,0 +1,163 @@
+#include <ncurses.h>
+#include <unistd.h>
+
+#include "backend.h"
+#include "cerr.h"
+#include "globs.h"
+#include "render.h"
+
+static bool	colors();
+static chtype	to_chtype(uint32_t const, int const);
+
+class curses_backend : public backend {
+	WINDOW *win;
+public:
+	curses_backend();
+	~curses_backend() override;
+
+	void
+	put(int const y, int const x, uint32_t const g, int const color)
+		override
+	{
+		(void)mvwaddch(win, y, x, to_chtype(g, color));
+	}
+
+	void
+	present() override
+	{
+		if (wrefresh(win) == ERR) {
+			cerrx(1, "curses present wrefresh");
+		}
+	}
+
+	/* called from the input thread, where wgetch is not safe */
+	int
+	get_key() override
+	{
+		return read_key(STDIN_FILENO);
+	}
+};
+
+curses_backend::curses_backend()
+{
+	(void)initscr();
+
+	if (!colors()) {
+		cerrx(1, "color init");
+	}
+
+	if (refresh() == ERR) {
+		cerrx(1, "refresh from initscr");
+	}
+
+	if ((win = newwin(HEIGHT, WIDTH, 0, 0)) == NULL) {
+		cerrx(1, "newwin");
+	}
+
+	if (curs_set(0) == ERR) {
+		cerrx(1, "curs_set");
+	}
+
+	if (noecho() == ERR) {
+		cerrx(1, "noecho");
+	}
+
+	if (raw() == ERR) {
+		cerrx(1, "raw");
+	}
+
+	if (keypad(win, true) == ERR) {
+		cerrx(1, "keypad");
+	}
+
+	/* keys are read elsewhere, don't let pending input cut refreshes short */
+	if (typeahead(-1) == ERR) {
+		cerrx(1, "typeahead");
+	}
+}
+
+curses_backend::~curses_backend()
+{
+	if (delwin(win) == ERR) {
+		cerrx(1, "delwin");
+	}
+
+	if (endwin() == ERR) {
+		cerrx(1, "endwin");
+	}
+}
+
+std::unique_ptr<backend>
+backend_curses()
+{
+	return std::make_unique<curses_backend>();
+}
+
+static bool
+colors()
+{
+	if (start_color() == ERR) {
+		return false;
+	}
+
+	if (init_pair(COLOR_BLUE, COLOR_BLUE, COLOR_BLACK) == ERR) {
+		return false;
+	}
+
+	if (init_pair(COLOR_CYAN, COLOR_CYAN, COLOR_BLACK) == ERR) {
+		return false;
+	}
+
+	if (init_pair(COLOR_GREEN, COLOR_GREEN, COLOR_BLACK) == ERR) {
+		return false;
+	}
+
+	if (init_pair(COLOR_MAGENTA, COLOR_MAGENTA, COLOR_BLACK) == ERR) {
+		return false;
+	}
+
+	if (init_pair(COLOR_RED, COLOR_RED, COLOR_BLACK) == ERR) {
+		return false;
+	}
+
+	if (init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK) == ERR) {
+		return false;
+	}
+
+	if (init_pair(COLOR_YELLOW, COLOR_YELLOW, COLOR_BLACK) == ERR) {
+		return false;
+	}
+
+	return true;
+}
+
+static chtype
+to_chtype(uint32_t const g, int const color)
+{
+	chtype const attr = static_cast<chtype>(color);
+
+	switch (g) {
+	case G_VLINE:
+		return ACS_VLINE | attr;
+	case G_HLINE:
+		return ACS_HLINE | attr;
+	case G_ULCORNER:
+		return ACS_ULCORNER | attr;
+	case G_URCORNER:
+		return ACS_URCORNER | attr;
+	case G_LLCORNER:
+		return ACS_LLCORNER | attr;
+	case G_LRCORNER:
+		return ACS_LRCORNER | attr;
+	case G_LTEE:
+		return ACS_LTEE | attr;
+	case G_RTEE:
+		return ACS_RTEE | attr;
+	case G_TTEE:
+		return ACS_TTEE | attr;
+	case G_BTEE:
+		return ACS_BTEE | attr;
+	default:
+		return static_cast<chtype>(g) | attr;
+	}
+}
@@ -0,0 +1,27 @@
+/*
+ * The sobel() filter from assignment 0, built with its main renamed so the
+ * microbenchmarks can call it on a synthetic image.
+ */
+#define main sobel_main
+#include "../assignment-0/sobel.c"
+#undef main
+
+void	bench_sobel(uint8_t (*)[SIZE], uint8_t (*)[SIZE]);
+
+void
+bench_sobel(uint8_t (*m)[SIZE], uint8_t (*out)[SIZE])
+{
+	static int8_t const k_x[KSIZE][KSIZE] = {
+		{-1, 0, 1},
+		{-2, 0, 2},
+		{-1, 0, 1}
+	};
+
+	static int8_t const k_y[KSIZE][KSIZE] = {
+		{-1, -2, -1},
+		{0, 0, 0},
+		{1, 2, 1}
+	};
+
+	sobel(m, k_x, k_y, out);
+}
@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+#include "alloc.h"
+#include "cache.h"
+#include "cerr.h"
+#include "lz.h"
+#include "npctab.h"
+#include "objtab.h"
+#include "rlg.h"
+#include "stats.h"
+#include "trace.h"
+
+struct cache_entry {
+	int			level;
+	std::size_t		raw; /* size unpacked */
+	bool			packed;
+	std::vector<uint8_t>	blob;
+};
+
+/* leads each blob, followed by the arrays it counts */
+struct cache_head {
+	uint64_t	turn; /* the PC's when it left */
+	uint16_t	rooms;
+	uint16_t	stairs_up;
+	uint16_t	stairs_dn;
+	uint16_t	npcs;
+	uint16_t	objs;
+	uint8_t		pc_x;
+	uint8_t		pc_y;
+};
+
+static cache_entry	pack_floor(int const, dungeon_floor const &,
+	std::vector<npc> const &, bool const);
+static bool	unpack_floor(cache_entry const &, dungeon_floor &);
+static void	put_entry(std::vector<uint8_t> &, cache_entry const &);
+static bool	take_entry(uint8_t const *&, uint8_t const *const,
+	cache_entry &);
+static void	put(std::vector<uint8_t> &, void const *, std::size_t const);
+static void	take(uint8_t const *&, void *, std::size_t const);
+static void	trim();
+
+/* leads each entry in a snapshot, see cache_save() */
+struct entry_head {
+	int32_t		level;
+	uint32_t	packed;
+	uint64_t	raw;
+	uint64_t	size;
+};
+
+static std::size_t constexpr TILES = HEIGHT * WIDTH;
+static std::size_t constexpr FOG_BYTES = (TILES + 7) / 8;
+
+/* least recently left first */
+static std::vector<cache_entry> entries;
+static std::size_t budget = CACHE_BUDGET;
+
+/* packed entries are unpacked here */
+static std::vector<uint8_t> scratch;
+
+/* what cache_get() found on the floor, until the engine takes it */
+static std::vector<npc> held_npcs;
+static std::vector<obj> held_objs;
+static uint64_t held_turn;
+static bool held;
+
+void
+cache_budget(std::size_t const b)
+{
+	budget = b;
+}
+
+bool
+cache_has(int const level)
+{
+	return std::any_of(entries.begin(), entries.end(),
+		[level](cache_entry const &e) { return e.level == level; });
+}
+
+void
+cache_put(int const level, dungeon_floor const &f,
+	std::vector<npc> const &npcs)
+{
+	TRACE_SPAN("cache_put");
+	ALLOC_PHASE(ALLOC_GEN);
+
+	entries.erase(std::remove_if(entries.begin(), entries.end(),
+		[level](cache_entry const &c) { return c.level == level; }),
+		entries.end());
+
+	entries.push_back(pack_floor(level, f, npcs, false));
+
+	trim();
+}
+
+/*
+ * Fill f with the floor at level if it was left earlier, and hold on to its
+ * NPCs and objects for cache_things(). The entry is used up, leaving puts
+ * it back.
+ */
+bool
+cache_get(int const level, dungeon_floor &f)
+{
+	TRACE_SPAN("cache_get");
+	ALLOC_PHASE(ALLOC_GEN);
+
+	auto const e = std::find_if(entries.begin(), entries.end(),
+		[level](cache_entry const &c) { return c.level == level; });
+
+	if (e == entries.end()) {
+		return false;
+	}
+
+	if (!unpack_floor(*e, f)) {
+		cerrx(1, "floor cache entry for level %d corrupt", level);
+	}
+
+	entries.erase(e);
+
+	stat_add(STAT_FLOORS_RESTORED);
+
+	return true;
+}
+
+/*
+ * Place what cache_get() held onto tiles and into the NPC table, NPCs
+ * taking their turns where they left off relative to the PC. False if the
+ * floor is a new one.
+ */
+bool
+cache_things()
+{
+	ALLOC_PHASE(ALLOC_SPAWN);
+
+	if (!held) {
+		return false;
+	}
+
+	uint64_t const elapsed = player.turn - held_turn;
+
+	for (auto const &n : held_npcs) {
+		npc_id const id = npc_new(n);
+		npc &c = npc_get(id);
+
+		/* the tables dice point at may be another run's, see cache_save() */
+		c.dam = dice_sampler(c.dam.base, c.dam.dice, c.dam.sides);
+		c.turn += elapsed;
+
+		if (!c.dead) {
+			tiles[c.y][c.x].n = id;
+		}
+	}
+
+	for (auto &o : held_objs) {
+		o.dam = dice_sampler(o.dam.base, o.dam.dice, o.dam.sides);
+		tiles[o.y][o.x].o = obj_new(o);
+	}
+
+	held = false;
+
+	return true;
+}
+
+/*
+ * The floor at a byte per tile, its fog as bits, then what is on it. The
+ * dead are kept too if all, as a snapshot needs the NPCs as they were.
+ */
+static cache_entry
+pack_floor(int const level, dungeon_floor const &f,
+	std::vector<npc> const &npcs, bool const all)
+{
+	cache_entry e = { level, 0, false, {} };
+	cache_head h = {};
+	uint8_t fog[FOG_BYTES] = {};
+
+	h.turn = player.turn;
+	h.rooms = (uint16_t)f.rooms.size();
+	h.stairs_up = (uint16_t)f.stairs_up.size();
+	h.stairs_dn = (uint16_t)f.stairs_dn.size();
+	h.pc_x = f.pc_x;
+	h.pc_y = f.pc_y;
+
+	for (auto const &n : npcs) {
+		if (all || (!n.dead && n.hp != 0)) {
+			h.npcs++;
+		}
+	}
+
+	for (std::size_t i = 0; i < TILES; ++i) {
+		tile const &t = f.t[i / WIDTH][i % WIDTH];
+
+		if (t.o != NO_OBJ) {
+			h.objs++;
+		}
+
+		if (t.v) {
+			fog[i / 8] = (uint8_t)(fog[i / 8] | 1 << i % 8);
+		}
+	}
+
+	e.blob.reserve(sizeof(h) + 2 * TILES + FOG_BYTES
+		+ h.rooms * sizeof(room)
+		+ (h.stairs_up + h.stairs_dn) * sizeof(stair)
+		+ h.npcs * sizeof(npc) + h.objs * sizeof(obj));
+
+	put(e.blob, &h, sizeof(h));
+
+	for (std::size_t i = 0; i < TILES; ++i) {
+		e.blob.push_back(f.t[i / WIDTH][i % WIDTH].h);
+	}
+
+	/* every character placed on a floor fits in a byte */
+	for (std::size_t i = 0; i < TILES; ++i) {
+		e.blob.push_back((uint8_t)f.t[i / WIDTH][i % WIDTH].c);
+	}
+
+	put(e.blob, fog, sizeof(fog));
+	put(e.blob, f.rooms.data(), h.rooms * sizeof(room));
+	put(e.blob, f.stairs_up.data(), h.stairs_up * sizeof(stair));
+	put(e.blob, f.stairs_dn.data(), h.stairs_dn * sizeof(stair));
+
+	for (auto const &n : npcs) {
+		if (all || (!n.dead && n.hp != 0)) {
+			put(e.blob, &n, sizeof(npc));
+		}
+	}
+
+	for (std::size_t i = 0; i < TILES; ++i) {
+		tile const &t = f.t[i / WIDTH][i % WIDTH];
+
+		if (t.o == NO_OBJ) {
+			continue;
+		}
+
+		obj o = obj_get(t.o);
+
+		o.x = t.x;
+		o.y = t.y;
+
+		put(e.blob, &o, sizeof(o));
+	}
+
+	e.raw = e.blob.size();
+
+	return e;
+}
+
+/*
+ * The floor at level, then every floor cached, packed or not, for a
+ * snapshot. All of npcs go, in order and dead or not, and as they are,
+ * dice and all; cache_things() rebinds their dice, so another run can
+ * restore them.
+ */
+void
+cache_save(std::vector<uint8_t> &out, int const level, dungeon_floor const &f,
+	std::vector<npc> const &npcs)
+{
+	uint64_t const n = entries.size();
+
+	put(out, &n, sizeof(n));
+	put_entry(out, pack_floor(level, f, npcs, true));
+
+	for (auto const &e : entries) {
+		put_entry(out, e);
+	}
+}
+
+/*
+ * Replace the cache with what cache_save() wrote at p, filling f and level
+ * with the floor that was being played and holding its NPCs and objects
+ * for cache_things(). False, with the cache untouched, if it is cut short
+ * or doesn't add up.
+ */
+bool
+cache_restore(uint8_t const *&p, uint8_t const *const end, int &level,
+	dungeon_floor &f)
+{
+	std::vector<cache_entry> got;
+	cache_entry cur;
+	uint64_t n;
+
+	if (end - p < (std::ptrdiff_t)sizeof(n)) {
+		return false;
+	}
+
+	take(p, &n, sizeof(n));
+
+	if (n > CACHE_FLOORS || !take_entry(p, end, cur)) {
+		return false;
+	}
+
+	got.resize(n);
+
+	for (auto &e : got) {
+		if (!take_entry(p, end, e)) {
+			return false;
+		}
+	}
+
+	if (!unpack_floor(cur, f)) {
+		return false;
+	}
+
+	level = cur.level;
+	entries = std::move(got);
+
+	return true;
+}
+
+/*
+ * f from e, holding its NPCs and objects; false if e doesn't add up or
+ * puts anything off the floor, as a snapshot's entries come from a file.
+ */
+static bool
+unpack_floor(cache_entry const &e, dungeon_floor &f)
+{
+	uint8_t const *p = e.blob.data();
+
+	if (!e.packed && e.blob.size() != e.raw) {
+		return false;
+	}
+
+	if (e.packed) {
+		scratch.clear();
+
+		if (!lz_unpack(scratch, e.blob.data(), e.blob.size(), e.raw)
+			|| scratch.size() != e.raw) {
+			return false;
+		}
+
+		p = scratch.data();
+	}
+
+	cache_head h;
+	uint8_t fog[FOG_BYTES];
+
+	if (e.raw < sizeof(h)) {
+		return false;
+	}
+
+	take(p, &h, sizeof(h));
+
+	if (e.raw != sizeof(h) + 2 * TILES + FOG_BYTES
+		+ h.rooms * sizeof(room)
+		+ (h.stairs_up + h.stairs_dn) * sizeof(stair)
+		+ h.npcs * sizeof(npc) + h.objs * sizeof(obj)) {
+		return false;
+	}
+
+	for (std::size_t i = 0; i < TILES; ++i) {
+		tile &t = f.t[i / WIDTH][i % WIDTH];
+
+		t = {};
+		t.x = (uint8_t)(i % WIDTH);
+		t.y = (uint8_t)(i / WIDTH);
+		t.h = p[i];
+		t.c = p[TILES + i];
+
+		/* until dijkstra() runs from where the PC comes back */
+		t.d = std::numeric_limits<int32_t>::max();
+		t.dt = std::numeric_limits<int32_t>::max();
+	}
+
+	p += 2 * TILES;
+	take(p, fog, sizeof(fog));
+
+	for (std::size_t i = 0; i < TILES; ++i) {
+		f.t[i / WIDTH][i % WIDTH].v = fog[i / 8] >> i % 8 & 1;
+	}
+
+	f.rooms.resize(h.rooms);
+	f.stairs_up.resize(h.stairs_up);
+	f.stairs_dn.resize(h.stairs_dn);
+	held_npcs.resize(h.npcs);
+	held_objs.resize(h.objs);
+
+	take(p, f.rooms.data(), h.rooms * sizeof(room));
+	take(p, f.stairs_up.data(), h.stairs_up * sizeof(stair));
+	take(p, f.stairs_dn.data(), h.stairs_dn * sizeof(stair));
+	take(p, held_npcs.data(), h.npcs * sizeof(npc));
+	take(p, held_objs.data(), h.objs * sizeof(obj));
+
+	f.pc_x = h.pc_x;
+	f.pc_y = h.pc_y;
+
+	auto const off = [](dungeon_thing const &t) {
+		return !rlg_inside(t.y, t.x);
+	};
+
+	if (!rlg_fits(f)
+		|| std::any_of(held_npcs.begin(), held_npcs.end(), off)
+		|| std::any_of(held_objs.begin(), held_objs.end(), off)) {
+		return false;
+	}
+
+	held_turn = h.turn;
+	held = true;
+
+	return true;
+}
+
+static void
+put_entry(std::vector<uint8_t> &out, cache_entry const &e)
+{
+	entry_head const h = { e.level, e.packed, e.raw, e.blob.size() };
+
+	put(out, &h, sizeof(h));
+	put(out, e.blob.data(), e.blob.size());
+}
+
+static bool
+take_entry(uint8_t const *&p, uint8_t const *const end, cache_entry &e)
+{
+	entry_head h;
+
+	if (end - p < (std::ptrdiff_t)sizeof(h)) {
+		return false;
+	}
+
+	take(p, &h, sizeof(h));
+
+	if ((uint64_t)(end - p) < h.size) {
+		return false;
+	}
+
+	e.level = h.level;
+	e.packed = h.packed != 0;
+	e.raw = h.raw;
+	e.blob.assign(p, p + h.size);
+
+	p += h.size;
+
+	return true;
+}
+
+static void
+put(std::vector<uint8_t> &blob, void const *const src, std::size_t const n)
+{
+	uint8_t const *const b = static_cast<uint8_t const *>(src);
+
+	blob.insert(blob.end(), b, b + n);
+}
+
+static void
+take(uint8_t const *&p, void *const dst, std::size_t const n)
+{
+	if (n != 0) {
+		(void)std::memcpy(dst, p, n);
+	}
+
+	p += n;
+}
+
+/*
+ * Drop the oldest, then pack whatever is past the budget, newest first.
+ * Level 0 is never dropped: it came from the session's generator or a
+ * loaded file, not from a stream build_ahead() could make it again from.
+ */
+static void
+trim()
+{
+	std::vector<uint8_t> packed;
+	std::size_t raw = 0;
+
+	if (entries.size() > CACHE_FLOORS) {
+		entries.erase(std::find_if(entries.begin(), entries.end(),
+			[](cache_entry const &e) { return e.level != 0; }));
+	}
+
+	for (auto e = entries.rbegin(); e != entries.rend(); ++e) {
+		if (e->packed) {
+			continue;
+		}
+
+		if (raw + e->raw <= budget) {
+			raw += e->raw;
+			continue;
+		}
+
+		packed.clear();
+		lz_pack(packed, e->blob.data(), e->blob.size());
+
+		e->blob.assign(packed.begin(), packed.end());
+		e->blob.shrink_to_fit();
+		e->packed = true;
+
+		stat_add(STAT_FLOORS_PACKED);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "floor.h"
+#include "globs.h"
+
+/*
+ * Floors left by the stairs, so going back restores one instead of making
+ * a new one. An entry holds the terrain at a byte per tile, the fog as a
+ * bitmap, and the NPCs and objects still on it. The most recently left
+ * floors are kept as is up to cache_budget() bytes, older ones are packed
+ * with lz.h, and past CACHE_FLOORS the least recently left is dropped,
+ * unless it is level 0, which can't be made again.
+ */
+std::size_t constexpr CACHE_FLOORS = 64;
+std::size_t constexpr CACHE_BUDGET = 64 * 1024;
+
+void	cache_budget(std::size_t const);
+bool	cache_has(int const);
+void	cache_put(int const, dungeon_floor const &, std::vector<npc> const &);
+bool	cache_get(int const, dungeon_floor &);
+bool	cache_things();
+
+/* every floor, for snapshots, see snap.h */
+void	cache_save(std::vector<uint8_t> &, int const, dungeon_floor const &,
+	std::vector<npc> const &);
+bool	cache_restore(uint8_t const *&, uint8_t const *const, int &,
+	dungeon_floor &);
+
+#endif /* CACHE_H */
@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "cave.h"
+#include "cerr.h"
+
+/* open cells [x0, x1) of row y, 8-connected to runs touching them */
+struct cave_run {
+	uint32_t	y;
+	uint32_t	x0;
+	uint32_t	x1;
+	uint32_t	parent;	/* never after it, so roots come first */
+};
+
+static uint64_t	splitmix(uint64_t &);
+static uint64_t	maj(uint64_t const, uint64_t const, uint64_t const);
+static void	row_sum(uint64_t const *, std::size_t const, uint64_t &,
+	uint64_t &);
+static uint64_t	pad_mask(cave_grid const &);
+static void	find_runs(cave_grid const &, std::vector<cave_run> &);
+static void	scan_word(std::vector<cave_run> &, std::size_t const,
+	uint32_t const, uint32_t const, uint64_t);
+static void	join_above(std::vector<cave_run> &, std::size_t const,
+	std::size_t const);
+static uint32_t	find(std::vector<cave_run> &, uint32_t);
+static void	fill_run(cave_grid &, cave_run const &);
+static bool	shaft(cave_grid &, cave_run const &);
+static void	tunnel(cave_grid &, cave_run const &, cave_run const &);
+static void	open_cell(cave_grid &, std::size_t const, std::size_t const);
+
+static uint64_t constexpr ALL = std::numeric_limits<uint64_t>::max();
+
+/* h by w cells, all rock */
+void
+cave_init(cave_grid &g, std::size_t const h, std::size_t const w)
+{
+	if (h == 0 || w == 0 || h > CAVE_MAX || w > CAVE_MAX) {
+		cerrx(1, "cave of %lux%lu invalid", (unsigned long)h,
+			(unsigned long)w);
+	}
+
+	g.h = h;
+	g.w = w;
+	g.stride = (w + 63) / 64 + 2;
+	g.bits.assign((h + 2) * g.stride, ALL);
+}
+
+/*
+ * Each cell rock with a chance of rock in 256, a random byte per cell
+ * compared bit-sliced against it, a bit of every byte a word at a time.
+ * The bytes come from splitmix64 seeded by rng, as drawing them all from
+ * rng would take longer than growing the cave.
+ */
+void
+cave_fill(cave_grid &g, ranged_random &rng, unsigned int const rock)
+{
+	uint64_t const pad = pad_mask(g);
+	uint64_t state = rng.rrand<uint64_t>(0, ALL);
+
+	for (std::size_t y = 1; y <= g.h; ++y) {
+		uint64_t *const row = &g.bits[y * g.stride];
+
+		for (std::size_t k = 1; k + 1 < g.stride; ++k) {
+			uint64_t lt = rock > 255 ? ALL : 0;
+			uint64_t eq = rock > 255 ? 0 : ALL;
+
+			for (int b = 7; b >= 0 && eq != 0; --b) {
+				uint64_t const r = splitmix(state);
+
+				if (rock >> b & 1) {
+					lt |= eq & ~r;
+					eq &= r;
+				} else {
+					eq &= ~r;
+				}
+			}
+
+			row[k] = lt;
+		}
+
+		row[g.stride - 2] |= pad;
+	}
+}
+
+/*
+ * One generation into next, which is then swapped with g so its buffer is
+ * reused by the next call. The nine cells around each are summed as the
+ * two bit sums of three across each of the three rows, then added down.
+ */
+void
+cave_step(cave_grid &g, cave_grid &next)
+{
+	std::size_t const s = g.stride;
+	uint64_t const pad = pad_mask(g);
+
+	next.h = g.h;
+	next.w = g.w;
+	next.stride = s;
+
+	/* only the cells are written, the padding stays rock */
+	if (next.bits.size() != g.bits.size()) {
+		next.bits.assign(g.bits.size(), ALL);
+	}
+
+	for (std::size_t y = 1; y <= g.h; ++y) {
+		uint64_t const *const up = &g.bits[(y - 1) * s];
+		uint64_t const *const mid = up + s;
+		uint64_t const *const dn = mid + s;
+		uint64_t *const out = &next.bits[y * s];
+
+		for (std::size_t k = 1; k + 1 < s; ++k) {
+			uint64_t u0, u1, m0, m1, d0, d1;
+
+			row_sum(up, k, u0, u1);
+			row_sum(mid, k, m0, m1);
+			row_sum(dn, k, d0, d1);
+
+			/* ones of the total, and the twos as x + 2y + c */
+			uint64_t const t = u0 ^ m0 ^ d0;
+			uint64_t const c = maj(u0, m0, d0);
+			uint64_t const x = u1 ^ m1 ^ d1;
+			uint64_t const yy = maj(u1, m1, d1);
+
+			/* five or more: three twos or more, or two and a one */
+			uint64_t const three = yy & (x | c);
+			uint64_t const two = (yy & ~(x | c)) | (~yy & x & c);
+
+			out[k] = three | (two & t);
+		}
+
+		out[s - 2] |= pad;
+	}
+
+	std::swap(g.bits, next.bits);
+}
+
+/*
+ * Label the 8-connected open regions, as runs of a row joined to those
+ * they touch in the row above. Regions of fewer than min cells are filled
+ * in, and if join the rest are joined up, else all but the largest are
+ * filled. Returns the cells of the largest, 0 if none is open.
+ *
+ * Joining, each region but the largest digs up from its first cell to
+ * the first open cell above, which is of a region or shaft begun higher
+ * up, so all end up joined to one begun at the top. Those that dig out of
+ * the top are tunnelled to the largest instead.
+ */
+std::size_t
+cave_connect(cave_grid &g, std::size_t const min, bool const join)
+{
+	/* kept, as a big grid has a million runs, per thread for opal-gen */
+	static thread_local std::vector<cave_run> runs;
+	static thread_local std::vector<uint32_t> size;
+
+	find_runs(g, runs);
+
+	if (runs.empty()) {
+		return 0;
+	}
+
+	size.assign(runs.size(), 0);
+	uint32_t largest = 0;
+
+	/* a parent before a run is already flat, so one pass flattens all */
+	for (uint32_t i = 0; i < runs.size(); ++i) {
+		uint32_t const r = runs[i].parent = runs[runs[i].parent].parent;
+
+		size[r] += runs[i].x1 - runs[i].x0;
+
+		if (size[r] > size[largest]) {
+			largest = r;
+		}
+	}
+
+	for (auto const &r : runs) {
+		if (r.parent != largest && (!join || size[r.parent] < min)) {
+			fill_run(g, r);
+		}
+	}
+
+	if (join) {
+		std::vector<uint32_t> top;
+
+		/* a region's root is its first run, in the order begun */
+		for (uint32_t i = 0; i < runs.size(); ++i) {
+			if (runs[i].parent == i && i != largest
+				&& size[i] >= min && !shaft(g, runs[i])) {
+				top.push_back(i);
+			}
+		}
+
+		for (auto const i : top) {
+			tunnel(g, runs[i], runs[largest]);
+		}
+	}
+
+	return size[largest];
+}
+
+bool
+cave_rock(cave_grid const &g, std::size_t const y, std::size_t const x)
+{
+	return g.bits[(y + 1) * g.stride + 1 + x / 64] >> x % 64 & 1;
+}
+
+static uint64_t
+splitmix(uint64_t &state)
+{
+	uint64_t z = (state += 0x9e3779b97f4a7c15);
+
+	z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9;
+	z = (z ^ z >> 27) * 0x94d049bb133111eb;
+
+	return z ^ z >> 31;
+}
+
+static uint64_t
+maj(uint64_t const a, uint64_t const b, uint64_t const c)
+{
+	return (a & b) | (c & (a ^ b));
+}
+
+/* word k of row plus its neighbours either side, as s0 + 2 * s1 */
+static void
+row_sum(uint64_t const *const row, std::size_t const k, uint64_t &s0,
+	uint64_t &s1)
+{
+	uint64_t const c = row[k];
+	uint64_t const w = c << 1 | row[k - 1] >> 63;
+	uint64_t const e = c >> 1 | row[k + 1] << 63;
+
+	s0 = w ^ c ^ e;
+	s1 = maj(w, c, e);
+}
+
+/* the bits of the last word of a row past the last cell */
+static uint64_t
+pad_mask(cave_grid const &g)
+{
+	return g.w % 64 == 0 ? 0 : ALL << g.w % 64;
+}
+
+/* runs row by row, each joined to those it touches above */
+static void
+find_runs(cave_grid const &g, std::vector<cave_run> &runs)
+{
+	std::size_t prev = 0;
+
+	runs.clear();
+
+	for (std::size_t y = 0; y < g.h; ++y) {
+		uint64_t const *const row = &g.bits[(y + 1) * g.stride];
+		std::size_t const first = runs.size();
+
+		for (std::size_t k = 1; k + 1 < g.stride; ++k) {
+			uint32_t const x = (uint32_t)((k - 1) * 64);
+
+			scan_word(runs, first, (uint32_t)y, x, ~row[k]);
+		}
+
+		join_above(runs, prev, first);
+		prev = first;
+	}
+}
+
+/* the runs of open bits, from x, those of row y begun at first */
+static void
+scan_word(std::vector<cave_run> &runs, std::size_t const first,
+	uint32_t const y, uint32_t const x, uint64_t open)
+{
+	while (open != 0) {
+		unsigned int const b = (unsigned int)__builtin_ctzll(open);
+		uint64_t const from = ~(open >> b);
+		unsigned int const len = from == 0 ? 64 - b
+			: (unsigned int)__builtin_ctzll(from);
+		uint32_t const x0 = x + b;
+
+		/* on from the last word */
+		if (runs.size() > first && runs.back().x1 == x0) {
+			runs.back().x1 = x0 + len;
+		} else {
+			uint32_t const i = (uint32_t)runs.size();
+
+			runs.push_back({ y, x0, x0 + len, i });
+		}
+
+		open = b + len == 64 ? 0 : open & ALL << (b + len);
+	}
+}
+
+/*
+ * Runs from first on against those of the row above in [prev, first),
+ * two pointers as both go left to right. The lower root wins.
+ */
+static void
+join_above(std::vector<cave_run> &runs, std::size_t const prev,
+	std::size_t const first)
+{
+	std::size_t j = prev;
+
+	for (std::size_t i = first; i < runs.size(); ++i) {
+		/* i's root, i itself until it touches one */
+		uint32_t r = (uint32_t)i;
+
+		while (j < first && runs[j].x1 < runs[i].x0) {
+			j++;
+		}
+
+		while (j < first && runs[j].x0 <= runs[i].x1) {
+			uint32_t const rj = find(runs, (uint32_t)j);
+
+			if (rj < r) {
+				runs[r].parent = rj;
+				r = rj;
+			} else if (r < rj) {
+				runs[rj].parent = r;
+			}
+
+			/* it may touch the next run too */
+			if (runs[j].x1 > runs[i].x1) {
+				break;
+			}
+
+			j++;
+		}
+
+		runs[i].parent = r;
+	}
+}
+
+/* halving the path as it goes */
+static uint32_t
+find(std::vector<cave_run> &runs, uint32_t i)
+{
+	while (runs[i].parent != i) {
+		runs[i].parent = runs[runs[i].parent].parent;
+		i = runs[i].parent;
+	}
+
+	return i;
+}
+
+static void
+fill_run(cave_grid &g, cave_run const &r)
+{
+	uint64_t *const row = &g.bits[(r.y + 1) * g.stride + 1];
+	std::size_t x = r.x0;
+
+	while (x < r.x1) {
+		std::size_t const b = x % 64;
+		std::size_t const n = std::min<std::size_t>(64 - b, r.x1 - x);
+		uint64_t const m = n == 64 ? ALL : ((uint64_t)1 << n) - 1;
+
+		row[x / 64] |= m << b;
+		x += n;
+	}
+}
+
+/*
+ * Up from r's first cell, the one above it rock as r begins there, to the
+ * first open cell. False if there is none, having dug to the top.
+ */
+static bool
+shaft(cave_grid &g, cave_run const &r)
+{
+	for (std::size_t y = r.y; y-- > 0;) {
+		if (!cave_rock(g, y, r.x0)) {
+			return true;
+		}
+
+		open_cell(g, y, r.x0);
+	}
+
+	return false;
+}
+
+/* across from a's first cell, then up or down to b's, as gen_corridor() */
+static void
+tunnel(cave_grid &g, cave_run const &a, cave_run const &b)
+{
+	for (std::size_t x = std::min(a.x0, b.x0); x <= std::max(a.x0, b.x0);
+		++x) {
+		open_cell(g, a.y, x);
+	}
+
+	for (std::size_t y = std::min(a.y, b.y); y <= std::max(a.y, b.y); ++y) {
+		open_cell(g, y, b.x0);
+	}
+}
+
+static void
+open_cell(cave_grid &g, std::size_t const y, std::size_t const x)
+{
+	g.bits[(y + 1) * g.stride + 1 + x / 64] &= ~((uint64_t)1 << x % 64);
+}
@@ -0,0 +1,34 @@
+#ifndef CAVE_H
+#define CAVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "rand.h"
+
+/*
+ * Caves grown by the 4-5 rule over a grid of bits, set for rock, 64 cells
+ * to a word. A cell is rock in the next generation if it and its eight
+ * neighbours hold five rock or more, all outside the grid counting as
+ * rock, which is worked out 64 cells at a time with bit-sliced adders.
+ * Rows are padded with a word of rock either side and a row of it above
+ * and below, so no cell needs an edge case. Up to CAVE_MAX a side.
+ */
+std::size_t constexpr CAVE_MAX = 4096;
+
+struct cave_grid {
+	std::size_t		h;
+	std::size_t		w;
+	std::size_t		stride;	/* words a row, padding included */
+	std::vector<uint64_t>	bits;
+};
+
+void	cave_init(cave_grid &, std::size_t const, std::size_t const);
+void	cave_fill(cave_grid &, ranged_random &, unsigned int const);
+void	cave_step(cave_grid &, cave_grid &);
+std::size_t	cave_connect(cave_grid &, std::size_t const, bool const);
+
+bool	cave_rock(cave_grid const &, std::size_t const, std::size_t const);
+
+#endif /* CAVE_H */
@@ -1,133 +1,484 @@
 #include <algorithm>
-#include <functional>
+#include <cerrno>
+#include <limits>
 #include <thread>
+
+#include <semaphore.h>
+
+#include "alloc.h"
 #include "cerr.h"
+#include "dijk.h"
 #include "globs.h"
+#include "stats.h"
+#include "trace.h"
 
-static void	dijkstra_d();
-static void	dijkstra_dt();
+static bool	dijkstra_d(int32_t (&)[HEIGHT][WIDTH], tile const (*const)[WIDTH],
+	uint8_t const, uint8_t const, std::atomic<bool> const *const);
+static bool	dijkstra_dt(int32_t (&)[HEIGHT][WIDTH], tile const (*const)[WIDTH],
+	uint8_t const, uint8_t const, std::atomic<bool> const *const);
 
-static void constexpr	calc_cost_d(tile const &, tile &);
-static void constexpr	calc_cost_dt(tile const &, tile &);
+static bool	cancelled(std::atomic<bool> const *const);
 
-struct compare_d {
-	bool constexpr
-	operator() (tile const &a, tile const &b) const
-	{
-		return a.d > b.d;
-	}
-};
+static void	spec_worker();
+static void	spec_join();
 
-struct compare_dt {
-	bool constexpr
-	operator() (tile const &a, tile const &b) const
-	{
-		return a.dt > b.dt;
-	}
+static void	dt_job();
+
+static void	pool_run(void (*const)(), int const);
+static void	pool_wait();
+static void	pool_main();
+
+/* the PC's current square and its 8 neighbours */
+static int constexpr SPEC_MAX = 9;
+
+struct spec_slot {
+	dist_field		f;
+	uint8_t			y;
+	uint8_t			x;
+	std::atomic<bool>	cancel;
+	bool			done;
 };
 
+static dist_field cur;
+
+static spec_slot spec[SPEC_MAX];
+static int spec_count;
+static std::atomic<int> spec_next;
+
+/*
+ * Workers live for the whole run, so a turn neither creates threads nor
+ * allocates. They are detached and left blocked on pool_work at exit.
+ */
+static sem_t pool_work;
+static sem_t pool_done;
+static void (*pool_job)();
+static int pool_size;
+static int pool_pending;
+
+/* distances to the PC, stored in tiles[][].d and .dt */
 void
 dijkstra()
 {
-	std::thread t1(dijkstra_d);
-	std::thread t2(dijkstra_dt);
+	TRACE_SPAN("dijkstra");
+	ALLOC_PHASE(ALLOC_DIJKSTRA);
+
+	stat_add(STAT_DIJK_CALLS);
+
+	/* the pool is shared with speculation */
+	spec_cancel();
 
-	t1.join();
-	t2.join();
+	pool_run(dt_job, 1);
+	(void)dijkstra_d(cur.d, tiles, player.y, player.x, nullptr);
+	pool_wait();
+
+	dist_apply(cur, tiles);
 }
 
-static void
-dijkstra_d()
+/*
+ * Reads only tile hardness, so it may run off the engine thread as long as
+ * nothing tunnels meanwhile. Returns false if cancelled part way.
+ */
+bool
+dist_compute(dist_field &f, tile const (*const t)[WIDTH], uint8_t const y,
+	uint8_t const x, std::atomic<bool> const *const cancel)
 {
-	std::vector<std::reference_wrapper<tile>> heap;
+	ALLOC_PHASE(ALLOC_DIJKSTRA);
 
-	for (std::size_t i = 1; i < HEIGHT - 1; ++i) {
-		for (std::size_t j = 1; j < WIDTH - 1; ++j) {
-			tiles[i][j].d = std::numeric_limits<int32_t>::max();
+	return dijkstra_d(f.d, t, y, x, cancel)
+		&& dijkstra_dt(f.dt, t, y, x, cancel);
+}
 
-			if (tiles[i][j].h == 0) {
-				tiles[i][j].vd = true;
-				heap.push_back(tiles[i][j]);
+void
+dist_apply(dist_field const &f, tile (*const t)[WIDTH])
+{
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			t[i][j].d = f.d[i][j];
+			t[i][j].dt = f.dt[i][j];
+		}
+	}
+}
+
+/*
+ * Just d, for callers outside the engine. Every step costs one, so a
+ * breadth-first fill finds what dijkstra_d() does without its heap.
+ */
+void
+dist_walk(int32_t (&d)[HEIGHT][WIDTH], tile const (*const t)[WIDTH],
+	uint8_t const y, uint8_t const x)
+{
+	int queue[HEIGHT * WIDTH];
+	int head = 0;
+	int tail = 0;
+
+	for (auto &row : d) {
+		std::fill(std::begin(row), std::end(row),
+			std::numeric_limits<int32_t>::max());
+	}
+
+	d[y][x] = 0;
+	queue[tail++] = y * WIDTH + x;
+
+	while (head < tail) {
+		int const ty = queue[head] / WIDTH;
+		int const tx = queue[head] % WIDTH;
+
+		head++;
+
+		/* the border is never open, so neighbours stay in bounds */
+		for (int i = ty - 1; i <= ty + 1; ++i) {
+			for (int j = tx - 1; j <= tx + 1; ++j) {
+				if (t[i][j].h != 0 || d[i][j]
+					!= std::numeric_limits<int32_t>::max()) {
+					continue;
+				}
+
+				d[i][j] = d[ty][tx] + 1;
+				queue[tail++] = i * WIDTH + j;
 			}
 		}
 	}
+}
 
-	tiles[player.y][player.x].d = 0;
+/*
+ * While the PC decides, compute the fields for every square the PC could
+ * be on after the move, using otherwise idle cores.
+ */
+void
+spec_start(uint8_t const y, uint8_t const x)
+{
+	unsigned int const cores = std::thread::hardware_concurrency();
 
-	while (!heap.empty()) {
-		std::make_heap(heap.begin(), heap.end(), compare_d());
+	spec_cancel();
 
-		tile &t = heap.front();
-		std::pop_heap(heap.begin(), heap.end(), compare_d());
-		heap.pop_back();
+	spec_count = 0;
 
-		calc_cost_d(t, tiles[t.y - 1][t.x + 0]);
-		calc_cost_d(t, tiles[t.y + 1][t.x + 0]);
+	for (int i = -1; i <= 1; ++i) {
+		for (int j = -1; j <= 1; ++j) {
+			uint8_t const ty = (uint8_t)(y + i);
+			uint8_t const tx = (uint8_t)(x + j);
 
-		calc_cost_d(t, tiles[t.y + 0][t.x - 1]);
-		calc_cost_d(t, tiles[t.y + 0][t.x + 1]);
+			if (tiles[ty][tx].h != 0) {
+				continue;
+			}
 
-		calc_cost_d(t, tiles[t.y + 1][t.x + 1]);
-		calc_cost_d(t, tiles[t.y - 1][t.x - 1]);
+			spec_slot &s = spec[spec_count++];
 
-		calc_cost_d(t, tiles[t.y - 1][t.x + 1]);
-		calc_cost_d(t, tiles[t.y + 1][t.x - 1]);
+			s.y = ty;
+			s.x = tx;
+			s.cancel = false;
+			s.done = false;
+		}
+	}
 
-		t.vd = false;
+	spec_next = 0;
+
+	pool_run(spec_worker, std::clamp<int>(static_cast<int>(cores), 1,
+		spec_count));
+}
+
+/* use the speculated fields for the PC's new square, if there are any */
+bool
+spec_commit(uint8_t const y, uint8_t const x)
+{
+	TRACE_SPAN("spec_commit");
+
+	spec_slot *hit = nullptr;
+
+	for (int i = 0; i < spec_count; ++i) {
+		if (spec[i].y == y && spec[i].x == x) {
+			hit = &spec[i];
+		} else {
+			spec[i].cancel = true;
+		}
+	}
+
+	if (hit == nullptr) {
+		spec_cancel();
+		return false;
+	}
+
+	/* the workers skip cancelled slots, so this finishes the hit */
+	spec_join();
+	spec_count = 0;
+
+	if (!hit->done) {
+		return false;
+	}
+
+	dist_apply(hit->f, tiles);
+
+	return true;
+}
+
+/* stop speculating; call before anything changes tile hardness */
+void
+spec_cancel()
+{
+	for (int i = 0; i < spec_count; ++i) {
+		spec[i].cancel = true;
 	}
+
+	spec_join();
+	spec_count = 0;
+}
+
+static bool
+dijkstra_d(int32_t (&d)[HEIGHT][WIDTH], tile const (*const t)[WIDTH],
+	uint8_t const y, uint8_t const x, std::atomic<bool> const *const cancel)
+{
+	bool valid[HEIGHT][WIDTH] = {};
+	int heap[HEIGHT * WIDTH];
+	int n = 0;
+
+	auto const cmp = [&d](int const a, int const b) {
+		return d[a / WIDTH][a % WIDTH] > d[b / WIDTH][b % WIDTH];
+	};
+
+	uint64_t nodes = 0;
+	uint64_t relaxed = 0;
+
+	auto const relax = [&d, &valid, &relaxed](int32_t const a, int const i,
+		int const j) {
+		if (valid[i][j] && d[i][j] > a) {
+			d[i][j] = a + 1;
+			relaxed++;
+		}
+	};
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			d[i][j] = std::numeric_limits<int32_t>::max();
+
+			if (i == 0 || j == 0 || i == HEIGHT - 1
+				|| j == WIDTH - 1) {
+				continue;
+			}
+
+			if (t[i][j].h == 0) {
+				valid[i][j] = true;
+				heap[n++] = i * WIDTH + j;
+			}
+		}
+	}
+
+	d[y][x] = 0;
+
+	while (n > 0) {
+		if (cancelled(cancel)) {
+			break;
+		}
+
+		nodes++;
+
+		std::make_heap(heap, heap + n, cmp);
+
+		int const top = heap[0];
+		std::pop_heap(heap, heap + n, cmp);
+		n--;
+
+		int const ty = top / WIDTH;
+		int const tx = top % WIDTH;
+		int32_t const a = d[ty][tx];
+
+		relax(a, ty - 1, tx + 0);
+		relax(a, ty + 1, tx + 0);
+
+		relax(a, ty + 0, tx - 1);
+		relax(a, ty + 0, tx + 1);
+
+		relax(a, ty + 1, tx + 1);
+		relax(a, ty - 1, tx - 1);
+
+		relax(a, ty - 1, tx + 1);
+		relax(a, ty + 1, tx - 1);
+
+		valid[ty][tx] = false;
+	}
+
+	stat_add(STAT_DIJK_NODES, nodes);
+	stat_add(STAT_DIJK_RELAX, relaxed);
+
+	return n == 0;
+}
+
+static bool
+dijkstra_dt(int32_t (&dt)[HEIGHT][WIDTH], tile const (*const t)[WIDTH],
+	uint8_t const y, uint8_t const x, std::atomic<bool> const *const cancel)
+{
+	bool valid[HEIGHT][WIDTH] = {};
+	int heap[HEIGHT * WIDTH];
+	int n = 0;
+
+	auto const cmp = [&dt](int const a, int const b) {
+		return dt[a / WIDTH][a % WIDTH] > dt[b / WIDTH][b % WIDTH];
+	};
+
+	/* the cost of leaving a tile grows with its hardness */
+	uint64_t nodes = 0;
+	uint64_t relaxed = 0;
+
+	auto const relax = [&dt, &valid, &relaxed](int32_t const a,
+		int32_t const cost, int const i, int const j) {
+		if (valid[i][j] && dt[i][j] > a + cost) {
+			dt[i][j] = a + 1 + cost;
+			relaxed++;
+		}
+	};
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			dt[i][j] = std::numeric_limits<int32_t>::max();
+
+			if (i == 0 || j == 0 || i == HEIGHT - 1
+				|| j == WIDTH - 1) {
+				continue;
+			}
+
+			valid[i][j] = true;
+			heap[n++] = i * WIDTH + j;
+		}
+	}
+
+	dt[y][x] = 0;
+
+	while (n > 0) {
+		if (cancelled(cancel)) {
+			break;
+		}
+
+		nodes++;
+
+		std::make_heap(heap, heap + n, cmp);
+
+		int const top = heap[0];
+		std::pop_heap(heap, heap + n, cmp);
+		n--;
+
+		int const ty = top / WIDTH;
+		int const tx = top % WIDTH;
+		int32_t const a = dt[ty][tx];
+		int32_t const cost = t[ty][tx].h / TUNNEL_STRENGTH;
+
+		relax(a, cost, ty - 1, tx + 0);
+		relax(a, cost, ty + 1, tx + 0);
+
+		relax(a, cost, ty + 0, tx - 1);
+		relax(a, cost, ty + 0, tx + 1);
+
+		relax(a, cost, ty + 1, tx + 1);
+		relax(a, cost, ty - 1, tx - 1);
+
+		relax(a, cost, ty - 1, tx + 1);
+		relax(a, cost, ty + 1, tx - 1);
+
+		valid[ty][tx] = false;
+	}
+
+	stat_add(STAT_DIJK_NODES, nodes);
+	stat_add(STAT_DIJK_RELAX, relaxed);
+
+	return n == 0;
+}
+
+static bool
+cancelled(std::atomic<bool> const *const cancel)
+{
+	return cancel != nullptr && cancel->load(std::memory_order_relaxed);
 }
 
 static void
-dijkstra_dt()
+spec_worker()
 {
-	std::vector<std::reference_wrapper<tile>> heap;
-	heap.reserve((HEIGHT - 1) * (WIDTH - 1));
+	int i;
+
+	while ((i = spec_next++) < spec_count) {
+		spec_slot &s = spec[i];
 
-	for (std::size_t i = 1; i < HEIGHT - 1; ++i) {
-		for (std::size_t j = 1; j < WIDTH - 1; ++j) {
-			tiles[i][j].dt = std::numeric_limits<int32_t>::max();
-			tiles[i][j].vdt = true;
-			heap.push_back(tiles[i][j]);
+		if (s.cancel) {
+			continue;
+		}
+
+		TRACE_SPAN("spec");
+
+		s.done = dist_compute(s.f, tiles, s.y, s.x, &s.cancel);
+
+		if (s.done) {
+			stat_add(STAT_DIJK_SPEC);
 		}
 	}
+}
+
+static void
+spec_join()
+{
+	pool_wait();
+}
 
-	tiles[player.y][player.x].dt = 0;
+static void
+dt_job()
+{
+	ALLOC_PHASE(ALLOC_DIJKSTRA);
 
-	while (!heap.empty()) {
-		std::make_heap(heap.begin(), heap.end(), compare_dt());
+	(void)dijkstra_dt(cur.dt, tiles, player.y, player.x, nullptr);
+}
 
-		tile &t = heap.front();
-		std::pop_heap(heap.begin(), heap.end(), compare_dt());
-		heap.pop_back();
+/* start job on n workers, at most one job at a time */
+static void
+pool_run(void (*const job)(), int const n)
+{
+	if (pool_size == 0) {
+		unsigned int const cores = std::thread::hardware_concurrency();
 
-		calc_cost_dt(t, tiles[t.y - 1][t.x + 0]);
-		calc_cost_dt(t, tiles[t.y + 1][t.x + 0]);
+		if (sem_init(&pool_work, 0, 0) == -1
+			|| sem_init(&pool_done, 0, 0) == -1) {
+			cerr(1, "pool sem_init");
+		}
 
-		calc_cost_dt(t, tiles[t.y + 0][t.x - 1]);
-		calc_cost_dt(t, tiles[t.y + 0][t.x + 1]);
+		/* all at once, so later turns never grow the pool */
+		pool_size = std::clamp<int>(static_cast<int>(cores), 1, SPEC_MAX);
 
-		calc_cost_dt(t, tiles[t.y + 1][t.x + 1]);
-		calc_cost_dt(t, tiles[t.y - 1][t.x - 1]);
+		for (int i = 0; i < pool_size; ++i) {
+			std::thread(pool_main).detach();
+		}
+	}
 
-		calc_cost_dt(t, tiles[t.y - 1][t.x + 1]);
-		calc_cost_dt(t, tiles[t.y + 1][t.x - 1]);
+	pool_job = job;
+	pool_pending = n;
 
-		t.vdt = false;
+	for (int i = 0; i < n; ++i) {
+		if (sem_post(&pool_work) == -1) {
+			cerr(1, "pool sem_post");
+		}
 	}
 }
 
-static void constexpr
-calc_cost_d(tile const &a, tile &b)
+static void
+pool_wait()
 {
-	if (b.vd && b.d > a.d) {
-		b.d = a.d + 1;
+	for (; pool_pending > 0; --pool_pending) {
+		while (sem_wait(&pool_done) == -1) {
+			if (errno != EINTR) {
+				cerr(1, "pool sem_wait done");
+			}
+		}
 	}
 }
 
-static void constexpr
-calc_cost_dt(tile const &a, tile &b)
+static void
+pool_main()
 {
-	if (b.vdt && b.dt > a.dt + a.h/TUNNEL_STRENGTH) {
-		b.dt = a.dt + 1 + a.h/TUNNEL_STRENGTH;
+	while (1) {
+		while (sem_wait(&pool_work) == -1) {
+			if (errno != EINTR) {
+				cerr(1, "pool sem_wait work");
+			}
+		}
+
+		pool_job();
+
+		if (sem_post(&pool_done) == -1) {
+			cerr(1, "pool sem_post");
+		}
 	}
 }
@@ -1,6 +1,27 @@
 #ifndef DIJK_H
 #define DIJK_H
 
+#include <atomic>
+#include <cstdint>
+
+#include "globs.h"
+
+/* distances to one source, laid out like tiles */
+struct dist_field {
+	int32_t	d[HEIGHT][WIDTH];
+	int32_t	dt[HEIGHT][WIDTH];
+};
+
 void	dijkstra();
 
+bool	dist_compute(dist_field &, tile const (*const)[WIDTH], uint8_t const,
+	uint8_t const, std::atomic<bool> const *const);
+void	dist_apply(dist_field const &, tile (*const)[WIDTH]);
+void	dist_walk(int32_t (&)[HEIGHT][WIDTH], tile const (*const)[WIDTH],
+	uint8_t const, uint8_t const);
+
+void	spec_start(uint8_t const, uint8_t const);
+bool	spec_commit(uint8_t const, uint8_t const);
+void	spec_cancel();
+
 #endif /* DIJK_H */
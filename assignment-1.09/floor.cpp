@@ -1,109 +1,384 @@
-#include "globs.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
 
-static bool	valid_room(room const &);
-static int	valid_corridor_x(int const, int const);
-static int	valid_corridor_y(int const, int const);
-static int	valid_stair(int const, int const);
+#include "cave.h"
+#include "cerr.h"
+#include "floor.h"
+#include "stats.h"
+
+static void	init_fresh(dungeon_floor &, ranged_random &, bool const);
+static void	init_caves(dungeon_floor &, ranged_random &);
+static bool	has_player(cave_grid const &);
+static void	cave_stair(dungeon_floor &, stair &, bool const,
+	ranged_random &);
+static void	place_player(dungeon_floor &, ranged_random &);
+static int	valid_player(dungeon_floor const &, int const, int const);
+static bool	valid_room(dungeon_floor const &, room const &);
+static int	occupied(dungeon_floor const &, int const, int const, int const,
+	int const);
+static int	valid_corridor_x(dungeon_floor const &, int const, int const);
+static int	valid_corridor_y(dungeon_floor const &, int const, int const);
+static int	valid_stair(dungeon_floor const &, int const, int const);
 
 static int constexpr MINROOMH = 4;
 static int constexpr MINROOMW = 3;
 static int constexpr MAXROOMH = 8;
 static int constexpr MAXROOMW = 15;
 
+static int constexpr NEW_ROOM_COUNT = 8;
+static int constexpr ROOM_RETRIES = 150;
+
+/* cells of 256 seeded rock, generations, and the least open kept */
+static unsigned int constexpr CAVE_ROCK = 115;
+static int constexpr CAVE_STEPS = 4;
+static std::size_t constexpr CAVE_MIN_REGION = 6;
+static std::size_t constexpr CAVE_MIN_OPEN = (HEIGHT - 2) * (WIDTH - 2) / 4;
+
+void
+clear_floor(dungeon_floor &f, ranged_random &rng)
+{
+	for (uint8_t i = 0; i < HEIGHT; ++i) {
+		for (uint8_t j = 0; j < WIDTH; ++j) {
+			tile &t = f.t[i][j];
+
+			t = {};
+			t.x = j;
+			t.y = i;
+
+			if (i == 0 || j == 0 || i == HEIGHT - 1
+				|| j == WIDTH - 1) {
+				t.h = std::numeric_limits<uint8_t>::max();
+				t.d = std::numeric_limits<int32_t>::max();
+				t.dt = std::numeric_limits<int32_t>::max();
+			} else {
+				t.c = ROCK;
+				t.h = rng.rrand<uint8_t>(1,
+					std::numeric_limits<uint8_t>::max() - 1);
+			}
+		}
+	}
+
+	for (auto &row : f.occ) {
+		std::fill(std::begin(row), std::end(row), 0);
+	}
+}
+
+void
+gen_floor(dungeon_floor &f, ranged_random &rng, floor_style const style)
+{
+	uint16_t const room_count = NEW_ROOM_COUNT;
+	uint16_t const stair_up_count = rng.rrand<uint16_t>(1,
+		(uint16_t)((room_count / 4) + 1));
+	uint16_t const stair_dn_count = rng.rrand<uint16_t>(1,
+		(uint16_t)((room_count / 4) + 1));
+
+	f.stairs_up.resize(stair_up_count);
+	f.stairs_dn.resize(stair_dn_count);
+
+	if (style == STYLE_CAVES) {
+		f.rooms.clear();
+		init_caves(f, rng);
+	} else {
+		f.rooms.resize(room_count);
+		init_fresh(f, rng, style == STYLE_FIT);
+	}
+}
+
+static void
+init_fresh(dungeon_floor &f, ranged_random &rng, bool const fit)
+{
+	std::size_t i = 0;
+	std::size_t retries = 0;
+
+	for (auto it = f.rooms.begin(); it != f.rooms.end()
+		&& retries < ROOM_RETRIES; ++it) {
+		if (!(fit ? fit_room : gen_room)(f, *it, rng)) {
+			retries++;
+			it--;
+		} else {
+			i++;
+			draw_room(f, *it);
+		}
+	}
+
+	stat_add(STAT_ROOM_RETRIES, retries);
+
+	if (i < f.rooms.size()) {
+		if (i == 0) {
+			cerrx(1, "unable to place any rooms");
+		}
+
+		f.rooms.resize(i);
+	}
+
+	for (i = 0; i < f.rooms.size() - 1; ++i) {
+		gen_corridor(f, f.rooms[i], f.rooms[i+1]);
+	}
+
+	for (auto &s : f.stairs_up) {
+		gen_stair(f, s, true, rng);
+	}
+
+	for (auto &s : f.stairs_dn) {
+		gen_stair(f, s, true, rng);
+	}
+
+	place_player(f, rng);
+}
+
+/*
+ * The inside of the border grown into one cave, open tiles as room floor.
+ * Grown again from where rng is now if too little of it is left open.
+ */
+static void
+init_caves(dungeon_floor &f, ranged_random &rng)
+{
+	cave_grid g, next;
+
+	do {
+		cave_init(g, HEIGHT - 2, WIDTH - 2);
+		cave_fill(g, rng, CAVE_ROCK);
+
+		for (int i = 0; i < CAVE_STEPS; ++i) {
+			cave_step(g, next);
+		}
+	} while (cave_connect(g, CAVE_MIN_REGION, true) < CAVE_MIN_OPEN
+		|| !has_player(g));
+
+	for (std::size_t y = 0; y < g.h; ++y) {
+		for (std::size_t x = 0; x < g.w; ++x) {
+			if (!cave_rock(g, y, x)) {
+				f.t[y + 1][x + 1].c = ROOM;
+				f.t[y + 1][x + 1].h = 0;
+			}
+		}
+	}
+
+	for (auto &s : f.stairs_up) {
+		cave_stair(f, s, true, rng);
+	}
+
+	for (auto &s : f.stairs_dn) {
+		cave_stair(f, s, false, rng);
+	}
+
+	place_player(f, rng);
+}
+
+/* somewhere valid_player() holds, so place_player() ends */
+static bool
+has_player(cave_grid const &g)
+{
+	for (std::size_t y = 1; y + 1 < g.h; ++y) {
+		for (std::size_t x = 1; x + 1 < g.w; ++x) {
+			if (!cave_rock(g, y, x)
+				&& !cave_rock(g, y - 1, x)
+				&& !cave_rock(g, y + 1, x)
+				&& !cave_rock(g, y, x - 1)
+				&& !cave_rock(g, y, x + 1)) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/* on any open tile, as there are no corridors for gen_stair() to want */
+static void
+cave_stair(dungeon_floor &f, stair &s, bool const up, ranged_random &rng)
+{
+	uint8_t x, y;
+
+	do {
+		x = rng.rrand<uint8_t>(1, WIDTH - 2);
+		y = rng.rrand<uint8_t>(1, HEIGHT - 2);
+	} while (f.t[y][x].c != ROOM);
+
+	f.t[y][x].c = up ? STAIR_UP : STAIR_DN;
+
+	s.x = x;
+	s.y = y;
+}
+
+static void
+place_player(dungeon_floor &f, ranged_random &rng)
+{
+	uint8_t x, y;
+
+	do {
+		x = rng.rrand<uint8_t>(1, WIDTH - 2);
+		y = rng.rrand<uint8_t>(1, HEIGHT - 2);
+	} while (!valid_player(f, y, x));
+
+	f.pc_x = x;
+	f.pc_y = y;
+}
+
+static int
+valid_player(dungeon_floor const &f, int const y, int const x)
+{
+	return f.t[y][x].h == 0
+		&& f.t[y + 1][x].h == 0 && f.t[y - 1][x].h == 0
+		&& f.t[y][x + 1].h == 0 && f.t[y][x - 1].h == 0;
+}
+
+bool
+gen_room(dungeon_floor &f, room &r, ranged_random &rng)
+{
+	r.x = rng.rrand<uint8_t>(1, WIDTH - 2);
+	r.y = rng.rrand<uint8_t>(1, HEIGHT - 2);
+	r.size_x = rng.rrand<uint8_t>(MINROOMW, MAXROOMW);
+	r.size_y = rng.rrand<uint8_t>(MINROOMH, MAXROOMH);
+
+	return valid_room(f, r);
+}
+
+/*
+ * Like gen_room(), but the spot is drawn from those the room fits at, so
+ * only a size that fits nowhere fails.
+ */
 bool
-gen_room(room &r)
+fit_room(dungeon_floor &f, room &r, ranged_random &rng)
 {
-	r.x = rr.rrand<uint8_t>(1, WIDTH - 2);
-	r.y = rr.rrand<uint8_t>(1, HEIGHT - 2);
-	r.size_x = rr.rrand<uint8_t>(MINROOMW, MAXROOMW);
-	r.size_y = rr.rrand<uint8_t>(MINROOMH, MAXROOMH);
+	/* top left corners, the margin kept off the border as in valid_room() */
+	room spots[(HEIGHT - 2) * (WIDTH - 2)];
+	std::size_t fits = 0;
+
+	r.size_x = rng.rrand<uint8_t>(MINROOMW, MAXROOMW);
+	r.size_y = rng.rrand<uint8_t>(MINROOMH, MAXROOMH);
+
+	/* the far margin at most on the last row and column inside */
+	int const max_y = HEIGHT - 3 - r.size_y;
+	int const max_x = WIDTH - 3 - r.size_x;
+
+	for (int y = 2; y <= max_y; ++y) {
+		for (int x = 2; x <= max_x; ++x) {
+			if (occupied(f, y - 1, x - 1, y + r.size_y + 2,
+				x + r.size_x + 2) == 0) {
+				spots[fits++] = { (uint8_t)x, (uint8_t)y,
+					r.size_x, r.size_y };
+			}
+		}
+	}
 
-	return valid_room(r);
+	if (fits == 0) {
+		return false;
+	}
+
+	r = spots[rng.rrand<std::size_t>(0, fits - 1)];
+
+	return true;
 }
 
 void
-draw_room(room const &r)
+draw_room(dungeon_floor &f, room const &r)
 {
-	for (int i = r.x; i < r.x + r.size_x; ++i) {
-		for (int j = r.y; j < r.y + r.size_y; ++j) {
-			tiles[j][i].c = ROOM;
-			tiles[j][i].h = 0;
+	int const x1 = r.x + r.size_x;
+	int const y1 = r.y + r.size_y;
+
+	for (int i = r.x; i < x1; ++i) {
+		for (int j = r.y; j < y1; ++j) {
+			f.t[j][i].c = ROOM;
+			f.t[j][i].h = 0;
+		}
+	}
+
+	/* add the room's overlap with each prefix below and right of it */
+	for (int j = r.y + 1; j <= HEIGHT; ++j) {
+		int const dy = std::min(j, y1) - r.y;
+
+		for (int i = r.x + 1; i <= WIDTH; ++i) {
+			int const dx = std::min(i, x1) - r.x;
+
+			f.occ[j][i] = (uint16_t)(f.occ[j][i] + dx * dy);
 		}
 	}
 }
 
 
 void
-gen_corridor(room const &r1, room const &r2)
+gen_corridor(dungeon_floor &f, room const &r1, room const &r2)
 {
 	for (int i = std::min(r1.x, r2.x); i <= std::max(r1.x, r2.x); ++i) {
-		if (valid_corridor_y(r1.y, i)) {
-			tiles[r1.y][i].c = CORRIDOR;
-			tiles[r1.y][i].h = 0;
+		if (valid_corridor_y(f, r1.y, i)) {
+			f.t[r1.y][i].c = CORRIDOR;
+			f.t[r1.y][i].h = 0;
 		}
 	}
 
 	for (int i = std::min(r1.y, r2.y); i <= std::max(r1.y, r2.y); ++i) {
-		if (valid_corridor_x(i, r2.x)) {
-			tiles[i][r2.x].c = CORRIDOR;
-			tiles[i][r2.x].h = 0;
+		if (valid_corridor_x(f, i, r2.x)) {
+			f.t[i][r2.x].c = CORRIDOR;
+			f.t[i][r2.x].h = 0;
 		}
 	}
 }
 
 void
-gen_stair(stair &s, bool const up)
+gen_stair(dungeon_floor &f, stair &s, bool const up, ranged_random &rng)
 {
 	uint8_t x, y;
 
 	do {
-		x = rr.rrand<uint8_t>(1, WIDTH - 2);
-		y = rr.rrand<uint8_t>(1, HEIGHT - 2);
-	} while (!valid_stair(y, x));
+		x = rng.rrand<uint8_t>(1, WIDTH - 2);
+		y = rng.rrand<uint8_t>(1, HEIGHT - 2);
+	} while (!valid_stair(f, y, x));
 
-	tiles[y][x].c = up ? STAIR_UP : STAIR_DN;
-	tiles[y][x].h = 0;
+	f.t[y][x].c = up ? STAIR_UP : STAIR_DN;
+	f.t[y][x].h = 0;
 
 	s.x = x;
 	s.y = y;
 }
 
+/* the room and a margin of rock around it, 2 wide right and below */
 static bool
-valid_room(room const &r)
+valid_room(dungeon_floor const &f, room const &r)
 {
-	for (int i = r.x - 1; i <= r.x + r.size_x + 1; ++i) {
-		for (int j = r.y - 1; j <= r.y + r.size_y + 1; ++j) {
-			if (tiles[j][i].c != ROCK) {
-				return false;
-			}
-		}
+	int const x0 = r.x - 1;
+	int const y0 = r.y - 1;
+	int const x1 = r.x + r.size_x + 2;
+	int const y1 = r.y + r.size_y + 2;
+
+	if (x0 < 1 || y0 < 1 || x1 > WIDTH - 1 || y1 > HEIGHT - 1) {
+		return false;
 	}
 
-	return true;
+	return occupied(f, y0, x0, y1, x1) == 0;
+}
+
+/* room tiles in [y0, y1) x [x0, x1) */
+static int
+occupied(dungeon_floor const &f, int const y0, int const x0, int const y1,
+	int const x1)
+{
+	return f.occ[y1][x1] - f.occ[y0][x1] - f.occ[y1][x0] + f.occ[y0][x0];
 }
 
 static int
-valid_corridor_x(int const y, int const x)
+valid_corridor_x(dungeon_floor const &f, int const y, int const x)
 {
-	return tiles[y][x].c == ROCK
-		&& tiles[y][x + 1].c != CORRIDOR
-		&& tiles[y][x - 1].c != CORRIDOR;
+	return f.t[y][x].c == ROCK
+		&& f.t[y][x + 1].c != CORRIDOR
+		&& f.t[y][x - 1].c != CORRIDOR;
 }
 
 static int
-valid_corridor_y(int const y, int const x)
+valid_corridor_y(dungeon_floor const &f, int const y, int const x)
 {
-	return tiles[y][x].c == ROCK
-		&& tiles[y + 1][x].c != CORRIDOR
-		&& tiles[y - 1][x].c != CORRIDOR;
+	return f.t[y][x].c == ROCK
+		&& f.t[y + 1][x].c != CORRIDOR
+		&& f.t[y - 1][x].c != CORRIDOR;
 }
 
 static int
-valid_stair(int const y, int const x)
+valid_stair(dungeon_floor const &f, int const y, int const x)
 {
-	return (tiles[y][x].c == ROCK || tiles[y][x].c == ROOM)
-		&& (tiles[y + 1][x].c == CORRIDOR
-		|| tiles[y - 1][x].c == CORRIDOR
-		|| tiles[y][x + 1].c == CORRIDOR
-		|| tiles[y][x - 1].c == CORRIDOR);
+	return (f.t[y][x].c == ROCK || f.t[y][x].c == ROOM)
+		&& (f.t[y + 1][x].c == CORRIDOR
+		|| f.t[y - 1][x].c == CORRIDOR
+		|| f.t[y][x + 1].c == CORRIDOR
+		|| f.t[y][x - 1].c == CORRIDOR);
 }
@@ -1,11 +1,38 @@
 #ifndef ROOM_H
 #define ROOM_H
 
+#include <vector>
+
 #include "globs.h"
 
-bool	gen_room(room &);
-void	draw_room(room const &);
-void	gen_corridor(room const &, room const &);
-void	gen_stair(stair &, bool const);
+/* a level's terrain, built in place so it can be made off the engine thread */
+struct dungeon_floor {
+	tile			t[HEIGHT][WIDTH];
+	std::vector<room>	rooms;
+	std::vector<stair>	stairs_up;
+	std::vector<stair>	stairs_dn;
+	uint8_t			pc_x;
+	uint8_t			pc_y;
+
+	/* tiles under rooms in [0, y) x [0, x), kept by draw_room() */
+	uint16_t		occ[HEIGHT + 1][WIDTH + 1];
+};
+
+/* how gen_floor() lays a floor out */
+enum floor_style : uint8_t {
+	STYLE_ROOMS,	/* rooms by gen_room(), joined by gen_corridor() */
+	STYLE_FIT,	/* the same, rooms by fit_room() */
+	STYLE_CAVES	/* open cave grown by cave_step() */
+};
+
+/* a whole floor, from rng alone so any thread can build one */
+void	clear_floor(dungeon_floor &, ranged_random &);
+void	gen_floor(dungeon_floor &, ranged_random &, floor_style const);
+
+bool	gen_room(dungeon_floor &, room &, ranged_random &);
+bool	fit_room(dungeon_floor &, room &, ranged_random &);
+void	draw_room(dungeon_floor &, room const &);
+void	gen_corridor(dungeon_floor &, room const &, room const &);
+void	gen_stair(dungeon_floor &, stair &, bool const, ranged_random &);
 
 #endif /* ROOM_H */
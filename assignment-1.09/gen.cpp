@@ -1,42 +1,59 @@
-#define _DEFAULT_SOURCE
-#define _BSD_SOURCE
-#include <endian.h>
-#undef _BSD_SOURCE
-#undef _DEFAULT_SOURCE
-
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <limits>
+#include <thread>
+
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "alloc.h"
+#include "arc.h"
+#include "cache.h"
 #include "cerr.h"
+#include "dijk.h"
 #include "floor.h"
+#include "gen.h"
 #include "globs.h"
+#include "rlg.h"
+#include "stats.h"
+#include "trace.h"
 
-static bool	save_things(FILE *const);
-static bool	load_things(FILE *const);
+static bool	save_things(int const);
+static bool	load_things(uint8_t const *, std::size_t const);
 
-static void	init_fresh();
-static void	place_player();
-static int	valid_player(int const, int const);
+static void	build_ahead(long unsigned int const, int const);
 
 static char const *const DIRECTORY = "/.rlg327";
 static char const *const FILEPATH = "/dungeon";
+static char const *const TMP_SUFFIX = ".tmp";
 static int constexpr DF_L = 8;
 
-static char const *const MARK = "RLG327-S2019";
-static int constexpr MARK_L = 12;
+static dungeon_floor floors[2];
+
+/* the floor being played, and the next one */
+static dungeon_floor *cur = &floors[0];
+static dungeon_floor *ahead = &floors[1];
 
-static int constexpr NEW_ROOM_COUNT = 8;
-static int constexpr ROOM_RETRIES = 150;
+/* the first floor is level 0, each '>' goes one deeper and '<' one up */
+static int level;
 
-static std::vector<stair> stairs_up;
-static std::vector<stair> stairs_dn;
+/* the level ahead holds or is being built for */
+static int constexpr NO_LEVEL = std::numeric_limits<int>::min();
+static int ahead_level = NO_LEVEL;
 
-static uint16_t room_count;
-static std::vector<room> rooms;
+/* how new floors are laid out */
+static floor_style style = STYLE_ROOMS;
 
-static uint16_t stair_up_count;
-static uint16_t stair_dn_count;
+/* a detached worker builds ahead and posts ahead_done when finished */
+static sem_t ahead_done;
+static bool ahead_init;
+static bool ahead_pending;
 
-tile tiles[HEIGHT][WIDTH];
+tile (*tiles)[WIDTH] = floors[0].t;
 
 std::string
 rlg_path()
@@ -55,11 +72,34 @@ rlg_path()
 	return std::string(home) + DIRECTORY;
 }
 
+/* flush the directory, so a file renamed into it stays after a crash */
+bool
+rlg_sync()
+{
+	int const fd = open(rlg_path().c_str(), O_RDONLY | O_DIRECTORY);
+
+	if (fd == -1) {
+		return false;
+	}
+
+	bool const ok = fsync(fd) == 0;
+
+	if (close(fd) == -1) {
+		return false;
+	}
+
+	return ok;
+}
+
+/*
+ * Whole, or not at all: written beside the old file and synced, then
+ * renamed over it, or a crash could leave the new name on an empty file.
+ */
 bool
 save_dungeon()
 {
 	struct stat st;
-	FILE *f;
+	int fd;
 	bool ret;
 
 	std::string path = rlg_path();
@@ -76,88 +116,122 @@ save_dungeon()
 
 	path += FILEPATH;
 
-	if (!(f = fopen(path.c_str(), "w"))) {
-		cerr(1, "save fopen");
+	std::string const tmp = path + TMP_SUFFIX;
+
+	if ((fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+		cerr(1, "save open");
 	}
 
-	ret = save_things(f);
+	ret = save_things(fd);
 
-	if (fclose(f) == EOF) {
-		cerr(1, "save fclose, (save_things=%d)", ret);
+	if (ret && fsync(fd) == -1) {
+		cerr(1, "save fsync");
 	}
 
-	return ret;
+	if (close(fd) == -1) {
+		cerr(1, "save close, (save_things=%d)", ret);
+	}
+
+	if (!ret) {
+		(void)unlink(tmp.c_str());
+		return false;
+	}
+
+	if (rename(tmp.c_str(), path.c_str()) == -1) {
+		cerr(1, "save rename");
+	}
+
+	if (!rlg_sync()) {
+		cerr(1, "save sync");
+	}
+
+	return true;
 }
 
 bool
 load_dungeon()
 {
-	FILE *f;
-	bool ret;
+	struct stat st;
+	int fd;
+	bool ret = false;
 	std::string path = rlg_path() + FILEPATH;
 
-	if (!(f = fopen(path.c_str(), "r"))) {
-		cerr(1, "load fopen");
+	if ((fd = open(path.c_str(), O_RDONLY)) == -1) {
+		cerr(1, "load open");
 	}
 
-	ret = load_things(f);
+	if (fstat(fd, &st) == -1) {
+		cerr(1, "load fstat");
+	}
+
+	/* mmap() refuses an empty file, and it can't hold a floor anyway */
+	if (st.st_size > 0) {
+		std::size_t const size = (std::size_t)st.st_size;
+		void *const m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-	if (fclose(f) == EOF) {
-		cerr(1, "load fclose, (load_things=%d)", ret);
+		if (m == MAP_FAILED) {
+			cerr(1, "load mmap");
+		}
+
+		ret = load_things(static_cast<uint8_t const *>(m), size);
+
+		if (munmap(m, size) == -1) {
+			cerr(1, "load munmap");
+		}
+	}
+
+	if (close(fd) == -1) {
+		cerr(1, "load close, (load_things=%d)", ret);
 	}
 
 	return ret;
 }
 
+/* floor i of an archive from opal-gen -a, in place of the dungeon file */
+bool
+load_archived(std::string const &path, uint64_t const i)
+{
+	std::vector<uint8_t> buf;
+
+	return arc_read(path, i, buf) && load_things(buf.data(), buf.size());
+}
+
+void
+arrange_style(floor_style const s)
+{
+	style = s;
+}
+
 void
 clear_tiles()
 {
-	for (uint8_t i = 0; i < HEIGHT; ++i) {
-		for (uint8_t j = 0; j < WIDTH; ++j) {
-			tiles[i][j] = {};
-			tiles[i][j].x = j;
-			tiles[i][j].y = i;
-
-			if (i == 0 || j == 0 || i == HEIGHT - 1
-				|| j == WIDTH - 1) {
-				tiles[i][j].h = std::numeric_limits<uint8_t>::max();
-				tiles[i][j].d = std::numeric_limits<int32_t>::max();
-				tiles[i][j].dt = std::numeric_limits<int32_t>::max();
-			} else {
-				tiles[i][j].c = ROCK;
-				tiles[i][j].h = rr.rrand<uint8_t>(1,
-					std::numeric_limits<uint8_t>::max() - 1);
-			}
-		}
-	}
+	clear_floor(*cur, rr);
 }
 
 void
 arrange_new()
 {
-	room_count = NEW_ROOM_COUNT;
-	stair_up_count = rr.rrand<uint16_t>(1, (uint16_t)((room_count / 4) + 1));
-	stair_dn_count = rr.rrand<uint16_t>(1, (uint16_t)((room_count / 4) + 1));
+	TRACE_SPAN("arrange_new");
+	ALLOC_PHASE(ALLOC_GEN);
 
-	rooms.resize(room_count);
-	stairs_up.resize(stair_up_count);
-	stairs_dn.resize(stair_dn_count);
+	gen_floor(*cur, rr, style);
 
-	init_fresh();
+	player.x = cur->pc_x;
+	player.y = cur->pc_y;
 }
 
 void
 arrange_loaded()
 {
-	for (auto const &r : rooms) {
-		draw_room(r);
+	for (auto const &r : cur->rooms) {
+		draw_room(*cur, r);
 	}
 
-	for (auto const &s : stairs_up) {
+	for (auto const &s : cur->stairs_up) {
 		tiles[s.y][s.x].c = STAIR_UP;
 	}
 
-	for (auto const &s : stairs_dn) {
+	for (auto const &s : cur->stairs_dn) {
 		tiles[s.y][s.x].c = STAIR_DN;
 	}
 
@@ -170,234 +244,173 @@ arrange_loaded()
 	}
 }
 
+/* keep the floor being left, and what is still on it, for the way back */
 void
-arrange_renew()
+arrange_leave(std::vector<npc> const &npcs)
 {
-	clear_tiles();
+	cur->pc_x = player.x;
+	cur->pc_y = player.y;
 
-	rooms.clear();
-	stairs_up.clear();
-	stairs_dn.clear();
-
-	arrange_new();
+	cache_put(level, *cur, npcs);
 }
 
-static bool
-save_things(FILE *const f)
+/* the floor being played and every one cached, for a snapshot */
+void
+arrange_save(std::vector<uint8_t> &out, std::vector<npc> const &npcs)
 {
-	uint32_t const ver = htobe32(0);
-	uint32_t const filesize = htobe32((uint32_t)(1708 + (room_count * 4)
-		+ (stair_up_count * 2) + (stair_dn_count * 2)));
+	cur->pc_x = player.x;
+	cur->pc_y = player.y;
 
-	/* type marker */
-	if (fwrite(MARK, MARK_L, 1, f) != 1) {
-		return false;
-	}
+	cache_save(out, level, *cur, npcs);
+}
 
-	/* version */
-	if (fwrite(&ver, sizeof(uint32_t), 1, f) != 1) {
-		return false;
-	}
+/* back to where arrange_save() was, the PC's struct restored already */
+bool
+arrange_restore(uint8_t const *&p, uint8_t const *const end)
+{
+	arrange_stop();
 
-	/* size */
-	if (fwrite(&filesize, sizeof(uint32_t), 1, f) != 1) {
+	if (!cache_restore(p, end, level, *cur)) {
 		return false;
 	}
 
-	/* player coords */
-	if (fwrite(&player.x, sizeof(uint8_t), 1, f) != 1) {
-		return false;
-	}
-	if (fwrite(&player.y, sizeof(uint8_t), 1, f) != 1) {
-		return false;
-	}
+	player.x = cur->pc_x;
+	player.y = cur->pc_y;
 
-	/* hardness */
-	for (std::size_t i = 0; i < HEIGHT; ++i) {
-		for (std::size_t j = 0; j < WIDTH; ++j) {
-			if (fwrite(&tiles[i][j].h, sizeof(uint8_t), 1, f) != 1) {
-				return false;
-			}
-		}
-	}
+	return true;
+}
 
-	/* room num */
-	room_count = htobe16(room_count);
-	if (fwrite(&room_count, sizeof(uint16_t), 1, f) != 1) {
-		return false;
-	}
-	room_count = be16toh(room_count);
+/*
+ * Move dir levels down. A floor left earlier comes back from the cache,
+ * with the PC where it left; otherwise the one built ahead is swapped in,
+ * distances and all, if it is the right level. Only waits if the player
+ * outran the builder.
+ */
+void
+arrange_renew(int const dir)
+{
+	TRACE_SPAN("arrange_renew");
+	ALLOC_PHASE(ALLOC_GEN);
 
-	/* room data */
-	for (auto const &r : rooms) {
-		if (fwrite(&r, sizeof(room), 1, f) != 1) {
-			return false;
-		}
-	}
+	int const to = level + dir;
 
-	/* stairs_up num */
-	stair_up_count = htobe16(stair_up_count);
-	if (fwrite(&stair_up_count, sizeof(uint16_t), 1, f) != 1) {
-		return false;
-	}
-	stair_up_count = be16toh(stair_up_count);
+	arrange_stop();
+
+	if (cache_get(to, *cur)) {
+		player.x = cur->pc_x;
+		player.y = cur->pc_y;
 
-	/* stars_up coords */
-	for (auto const &s : stairs_up) {
-		if (fwrite(&s, sizeof(stair), 1, f) != 1) {
-			return false;
+		dijkstra();
+	} else {
+		if (ahead_level != to) {
+			build_ahead(rr.seed, to);
 		}
-	}
 
-	/* stairs_dn num */
-	stair_dn_count = htobe16(stair_dn_count);
-	if (fwrite(&stair_dn_count, sizeof(uint16_t), 1, f) != 1) {
-		return false;
-	}
-	stair_dn_count = be16toh(stair_dn_count);
+		std::swap(cur, ahead);
+		tiles = cur->t;
 
-	/* stairs_dn coords */
-	for (auto const &s : stairs_dn) {
-		if (fwrite(&s, sizeof(stair), 1, f) != 1) {
-			return false;
-		}
+		player.x = cur->pc_x;
+		player.y = cur->pc_y;
 	}
 
-	return true;
+	level = to;
+
+	arrange_ahead();
 }
 
-static bool
-load_things(FILE *const f)
+/* build a neighbouring level not seen yet while this one is played */
+void
+arrange_ahead()
 {
-	/* skip type marker, version, and size */
-	if (fseek(f, MARK_L + 2 * sizeof(uint32_t), SEEK_SET) == -1) {
-		return false;
-	}
-
-	/* player coords */
-	if (fread(&player.x, sizeof(uint8_t), 1, f) != 1) {
-		return false;
-	}
-	if (fread(&player.y, sizeof(uint8_t), 1, f) != 1) {
-		return false;
-	}
-
-	/* hardness */
-	for (std::size_t i = 0; i < HEIGHT; ++i) {
-		for (std::size_t j = 0; j < WIDTH; ++j) {
-			if (fread(&tiles[i][j].h, sizeof(uint8_t), 1, f) != 1) {
-				return false;
-			}
+	if (!ahead_init) {
+		if (sem_init(&ahead_done, 0, 0) == -1) {
+			cerr(1, "ahead sem_init");
 		}
-	}
 
-	/* room num */
-	if (fread(&room_count, sizeof(uint16_t), 1, f) != 1) {
-		return false;
+		ahead_init = true;
 	}
-	room_count = be16toh(room_count);
 
-	rooms.resize(room_count);
+	arrange_stop();
 
-	/* room data */
-	for (auto &r : rooms) {
-		if (fread(&r, sizeof(room), 1, f) != 1) {
-			return false;
-		}
+	if (!cache_has(level + 1)) {
+		ahead_level = level + 1;
+	} else if (!cache_has(level - 1)) {
+		ahead_level = level - 1;
+	} else {
+		ahead_level = NO_LEVEL;
+		return;
 	}
 
-	/* stair_up num */
-	if (fread(&stair_up_count, sizeof(uint16_t), 1, f) != 1) {
-		return false;
-	}
-	stair_up_count = be16toh(stair_up_count);
+	ahead_pending = true;
 
-	stairs_up.resize(stair_up_count);
+	std::thread([seed = rr.seed, to = ahead_level] {
+		build_ahead(seed, to);
 
-	/* stair_up coords */
-	for (auto &s : stairs_up) {
-		if (fread(&s, sizeof(stair), 1, f) != 1) {
-			return false;
+		if (sem_post(&ahead_done) == -1) {
+			cerr(1, "ahead sem_post");
 		}
-	}
+	}).detach();
+}
 
-	/* stair_dn num */
-	if (fread(&stair_dn_count, sizeof(uint16_t), 1, f) != 1) {
-		return false;
+/* wait for the worker, if any; call before exit */
+void
+arrange_stop()
+{
+	if (!ahead_pending) {
+		return;
 	}
-	stair_dn_count = be16toh(stair_dn_count);
 
-	stairs_dn.resize(stair_dn_count);
-
-	/* stair_dn_coords */
-	for (auto &s : stairs_dn) {
-		if (fread(&s, sizeof(stair), 1, f) != 1) {
-			return false;
+	while (sem_wait(&ahead_done) == -1) {
+		if (errno != EINTR) {
+			cerr(1, "ahead sem_wait");
 		}
 	}
 
-	return true;
+	ahead_pending = false;
 }
 
-static void
-init_fresh()
+static bool
+save_things(int const fd)
 {
-	std::size_t i = 0;
-	std::size_t retries = 0;
-
-	for (auto it = rooms.begin(); it != rooms.end()
-		&& retries < ROOM_RETRIES; ++it) {
-		if (!gen_room(*it)) {
-			retries++;
-			it--;
-		} else {
-			i++;
-			draw_room(*it);
-		}
-	}
+	std::vector<uint8_t> buf;
 
-	if (i < room_count) {
-		if (i == 0) {
-			cerrx(1, "unable to place any rooms");
-		}
+	cur->pc_x = player.x;
+	cur->pc_y = player.y;
 
-		room_count = (uint16_t)i;
-		rooms.resize(room_count);
-	}
+	rlg_encode(buf, *cur);
 
-	for (i = 0; i < room_count - 1U; ++i) {
-		gen_corridor(rooms[i], rooms[i+1]);
-	}
+	return write(fd, buf.data(), buf.size()) == (ssize_t)buf.size();
+}
 
-	for (auto &s : stairs_up) {
-		gen_stair(s, true);
+static bool
+load_things(uint8_t const *const buf, std::size_t const size)
+{
+	if (!rlg_decode(*cur, buf, size)) {
+		return false;
 	}
 
-	for (auto &s : stairs_dn) {
-		gen_stair(s, true);
-	}
+	player.x = cur->pc_x;
+	player.y = cur->pc_y;
 
-	place_player();
+	return true;
 }
 
+/*
+ * The floor at level to with its distances, touching nothing but ahead.
+ * Level n uses RNG stream n, negative levels wrap.
+ */
 static void
-place_player()
+build_ahead(long unsigned int const seed, int const to)
 {
-	uint8_t x, y;
+	TRACE_SPAN("build_ahead");
+	ALLOC_PHASE(ALLOC_GEN);
 
-	do {
-		x = rr.rrand<uint8_t>(1, WIDTH - 2);
-		y = rr.rrand<uint8_t>(1, HEIGHT - 2);
-	} while (!valid_player(y, x));
+	static dist_field dist;
+	ranged_random rng(seed, static_cast<uint64_t>(static_cast<int64_t>(to)));
 
-	player.x = x;
-	player.y = y;
-}
+	clear_floor(*ahead, rng);
+	gen_floor(*ahead, rng, style);
 
-static int
-valid_player(int const y, int const x)
-{
-	return tiles[y][x].h == 0
-		&& tiles[y + 1][x].h == 0 && tiles[y - 1][x].h == 0
-		&& tiles[y][x + 1].h == 0 && tiles[y][x - 1].h == 0;
+	(void)dist_compute(dist, ahead->t, ahead->pc_y, ahead->pc_x, nullptr);
+	dist_apply(dist, ahead->t);
 }
@@ -1,18 +1,31 @@
 #ifndef GEN_H
 #define GEN_H
 
+#include <cstdint>
 #include <string>
+#include <vector>
+
+#include "floor.h"
+#include "globs.h"
 
 std::string	rlg_path();
+bool		rlg_sync();
 
 /* io */
 bool	save_dungeon();
 bool	load_dungeon();
+bool	load_archived(std::string const &, uint64_t const);
 
 /* gen */
+void	arrange_style(floor_style const);
 void	clear_tiles();
 void	arrange_new();
 void	arrange_loaded();
-void	arrange_renew();
+void	arrange_leave(std::vector<npc> const &);
+void	arrange_renew(int const);
+void	arrange_ahead();
+void	arrange_stop();
+void	arrange_save(std::vector<uint8_t> &, std::vector<npc> const &);
+bool	arrange_restore(uint8_t const *&, uint8_t const *const);
 
 #endif /* GEN_H */
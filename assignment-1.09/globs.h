@@ -2,10 +2,11 @@
 #define GLOBS_H
 
 #include <cstdint>
-#include <ncurses.h>
+#include <type_traits>
 #include <vector>
 
 #include "rand.h"
+#include "strpool.h"
 
 int constexpr WIDTH = 80;
 int constexpr HEIGHT = 21;
@@ -43,39 +44,17 @@ uint16_t constexpr PASS = 1 << 6;
 uint16_t constexpr PICKUP = 1 << 7;
 uint16_t constexpr UNIQ = 1 << 8;
 
-struct dice {
-	uint64_t	base;
-	uint64_t	dice;
-	uint64_t	sides;
-};
-
 struct dungeon_thing {
-	std::string	desc;
-	std::string	name;
+	str_id		desc;
+	str_id		name;
 	uint64_t	speed;
-	dice		dam;
+	dice_sampler	dam;
 	int		color; /* first color as ncurses COLOR_PAIR(COLOR_*) value */
 	unsigned int	symb;
 	uint8_t		rrty;
 	uint8_t		x;
 	uint8_t		y;
 	bool		done;
-
-	dungeon_thing() = default;
-
-	dungeon_thing(dungeon_thing const &t)
-	{
-		color = t.color;
-		desc = t.desc;
-		name = t.name;
-		dam = t.dam;
-		symb = t.symb;
-		rrty = t.rrty;
-		speed = t.speed;
-		x = 0;
-		y = 0;
-		done = false;
-	}
 };
 
 struct npc : dungeon_thing {
@@ -84,17 +63,6 @@ struct npc : dungeon_thing {
 	uint64_t	turn;
 	uint16_t	type;
 	bool		dead;
-
-	npc() = default;
-
-	npc(npc const &n) : dungeon_thing(n)
-	{
-		type = n.type;
-		hp = n.hp;
-		turn = 0;
-		p_count = 0;
-		dead = n.dead;
-	}
 };
 
 enum type {
@@ -128,22 +96,23 @@ struct obj : dungeon_thing {
 	uint64_t	attr;
 	type		obj_type;
 	bool		art;
-
-	obj() = default;
-
-	obj(obj const &o) : dungeon_thing(o)
-	{
-		def = o.def;
-		dodge = o.dodge;
-		hit = o.hit;
-		val = o.val;
-		weight = o.weight;
-		attr = o.attr;
-		obj_type = o.obj_type;
-		art = o.art;
-	}
 };
 
+/* instances are spawned by copying parsed templates */
+static_assert(std::is_trivially_copyable_v<npc>);
+static_assert(std::is_trivially_copyable_v<obj>);
+
+/* handle into the object table, see objtab.h */
+typedef uint32_t obj_handle;
+
+obj_handle constexpr NO_OBJ = 0;
+
+/* id in the floor's NPC table, see npctab.h */
+typedef uint16_t npc_id;
+
+npc_id constexpr NO_NPC = 0;
+npc_id constexpr PC_ID = 1;
+
 struct room {
 	uint8_t	x;
 	uint8_t	y;
@@ -158,11 +127,11 @@ struct stair {
 
 struct tile {
 	/* turn engine */
-	npc	*n;
-	obj	*o;
+	npc_id	n;
+	obj_handle	o;
 
 	uint8_t	h; /* hardness */
-	chtype	c; /* character */
+	uint32_t	c; /* character */
 
 	uint8_t	x;
 	uint8_t	y;
@@ -171,10 +140,6 @@ struct tile {
 	int32_t	d;
 	int32_t	dt;
 
-	/* dijkstra valid node */
-	bool	vd;
-	bool	vdt;
-
 	/* visited by PC */
 	bool	v;
 };
@@ -183,7 +148,8 @@ extern ranged_random rr;
 
 extern npc player;
 
-extern tile tiles[HEIGHT][WIDTH];
+/* the floor being played, see arrange_renew() */
+extern tile (*tiles)[WIDTH];
 
 extern std::vector<npc> npcs_parsed;
 extern std::vector<obj> objs_parsed;
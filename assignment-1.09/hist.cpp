@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+#include "hist.h"
+
+static void	print_ns(std::ostream &, uint64_t const);
+
+void
+latency_hist::record(uint64_t const v)
+{
+	counts[index(v)]++;
+	n++;
+
+	if (v > max_v) {
+		max_v = v;
+	}
+}
+
+/* highest value equivalent to the p-th percentile, p in [0, 100] */
+uint64_t
+latency_hist::percentile(double const p) const
+{
+	uint64_t const want = std::max<uint64_t>(1,
+		static_cast<uint64_t>(std::ceil(p / 100.0
+		* static_cast<double>(n))));
+	uint64_t seen = 0;
+
+	if (n == 0) {
+		return 0;
+	}
+
+	for (int i = 0; i < BUCKETS; ++i) {
+		seen += counts[i];
+
+		if (seen >= want) {
+			return std::min(highest(i), max_v);
+		}
+	}
+
+	return max_v;
+}
+
+/*
+ * Values below 2^SUB_BITS get a bucket each. Above that, each power of two
+ * is split into 2^(SUB_BITS - 1) equal buckets, indexed by the value's top
+ * SUB_BITS bits.
+ */
+int
+latency_hist::index(uint64_t const v)
+{
+	if (v < (1u << SUB_BITS)) {
+		return static_cast<int>(v);
+	}
+
+	int const e = 64 - __builtin_clzll(v) - SUB_BITS;
+
+	return (e << (SUB_BITS - 1)) + static_cast<int>(v >> e);
+}
+
+uint64_t
+latency_hist::highest(int const i)
+{
+	if (i < (1 << SUB_BITS)) {
+		return static_cast<uint64_t>(i);
+	}
+
+	int const e = (i >> (SUB_BITS - 1)) - 1;
+	uint64_t const sub = static_cast<uint64_t>(i - (e << (SUB_BITS - 1)));
+
+	return ((sub + 1) << e) - 1;
+}
+
+void
+hist_print(std::ostream &os, char const *const label, latency_hist const &h)
+{
+	os << label << ": " << h.count() << " keys";
+
+	if (h.count() != 0) {
+		os << ", p50 ";
+		print_ns(os, h.percentile(50.0));
+		os << ", p99 ";
+		print_ns(os, h.percentile(99.0));
+		os << ", p99.9 ";
+		print_ns(os, h.percentile(99.9));
+		os << ", max ";
+		print_ns(os, h.max());
+	}
+
+	os << '\n';
+}
+
+static void
+print_ns(std::ostream &os, uint64_t const ns)
+{
+	char buf[32];
+
+	if (ns < 1000000) {
+		(void)snprintf(buf, sizeof(buf), "%" PRIu64 " us", ns / 1000);
+	} else {
+		(void)snprintf(buf, sizeof(buf), "%.2f ms",
+			static_cast<double>(ns) / 1e6);
+	}
+
+	os << buf;
+}
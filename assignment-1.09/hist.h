@@ -0,0 +1,33 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <cstdint>
+#include <ostream>
+
+/*
+ * HDR-style histogram of nanosecond latencies: log-linear buckets keep
+ * every value to within 1/64 of its true size from 1 ns up to the full
+ * uint64_t range, in fixed memory and with O(1) recording.
+ */
+class latency_hist {
+	static int constexpr SUB_BITS = 7;
+	static int constexpr BUCKETS = ((64 - SUB_BITS + 1) << (SUB_BITS - 1))
+		+ (1 << (SUB_BITS - 1));
+
+	uint64_t	counts[BUCKETS] = {};
+	uint64_t	n = 0;
+	uint64_t	max_v = 0;
+
+	static int	index(uint64_t const);
+	static uint64_t	highest(int const);
+public:
+	void	record(uint64_t const);
+
+	uint64_t	count() const { return n; }
+	uint64_t	max() const { return max_v; }
+	uint64_t	percentile(double const) const;
+};
+
+void	hist_print(std::ostream &, char const *const, latency_hist const &);
+
+#endif /* HIST_H */
@@ -0,0 +1,299 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include <ncurses.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#include "cerr.h"
+#include "input.h"
+#include "replay.h"
+#include "trace.h"
+
+using steady = std::chrono::steady_clock;
+
+static void	reader();
+static void	join_reader();
+static bool	push(int const);
+static int	pop();
+static int	take();
+static int	consume(int const);
+static void	go_live();
+
+/* power of two; a full ring makes the reader wait, keys are never dropped */
+static std::size_t constexpr RING_SIZE = 64;
+
+static int ring[RING_SIZE];
+
+/* head written by the reader only, tail by the engine only */
+alignas(64) static std::atomic<std::size_t> head;
+alignas(64) static std::atomic<std::size_t> tail;
+
+/* counts keys in the ring, so an empty wait sleeps instead of spinning */
+static sem_t avail;
+
+static backend *be;
+static std::thread thr;
+static int stop_pipe[2] = { -1, -1 };
+
+/* when the last key was taken, until the frame showing its effect */
+static bool pending;
+static steady::time_point pending_at;
+
+static latency_hist session;
+static std::vector<latency_hist> floors(1);
+
+void
+input_start(backend *const b)
+{
+	be = b;
+
+	if (sem_init(&avail, 0, 0) == -1) {
+		cerr(1, "input sem_init");
+	}
+
+	if (pipe(stop_pipe) == -1) {
+		cerr(1, "input pipe");
+	}
+
+	if (atexit(join_reader) != 0) {
+		cerrx(1, "input atexit");
+	}
+
+	if (!replaying()) {
+		go_live();
+	}
+}
+
+void
+input_stop()
+{
+	char const c = 0;
+
+	if (thr.joinable()) {
+		if (write(stop_pipe[1], &c, 1) == -1) {
+			cerr(1, "input stop write");
+		}
+
+		thr.join();
+	}
+
+	(void)close(stop_pipe[0]);
+	(void)close(stop_pipe[1]);
+	(void)sem_destroy(&avail);
+}
+
+/* block until a key is available */
+int
+input_wait()
+{
+	int key;
+
+	TRACE_SPAN("input_wait");
+
+	if (replay_key(key)) {
+		return consume(key);
+	}
+
+	go_live();
+
+	while (sem_wait(&avail) == -1) {
+		if (errno != EINTR) {
+			cerr(1, "input sem_wait");
+		}
+	}
+
+	return take();
+}
+
+/* take a key if one is ready, without blocking */
+bool
+input_poll(int &key)
+{
+	if (replay_key(key)) {
+		key = consume(key);
+		return true;
+	}
+
+	go_live();
+
+	if (sem_trywait(&avail) == -1) {
+		return false;
+	}
+
+	key = take();
+
+	return true;
+}
+
+/*
+ * The action for the last key is on screen, NPC turns included; record the
+ * time since the engine got the key.
+ */
+void
+input_acted()
+{
+	if (!pending) {
+		return;
+	}
+
+	pending = false;
+
+	uint64_t const ns = static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+		steady::now() - pending_at).count());
+
+	session.record(ns);
+	floors.back().record(ns);
+}
+
+/* keys from now on count towards the next floor */
+void
+input_next_floor()
+{
+	floors.emplace_back();
+}
+
+latency_hist const &
+input_session_latency()
+{
+	return session;
+}
+
+std::vector<latency_hist> const &
+input_floor_latency()
+{
+	return floors;
+}
+
+/*
+ * On any exit(), cerr() and cerrx() included, as a std::thread still
+ * joinable when it is destroyed aborts the process. Joined if it can be
+ * told to stop, else detached, as it is if it is the one exiting.
+ */
+static void
+join_reader()
+{
+	char const c = 0;
+
+	if (!thr.joinable()) {
+		return;
+	}
+
+	if (thr.get_id() == std::this_thread::get_id()
+		|| write(stop_pipe[1], &c, 1) == -1) {
+		thr.detach();
+	} else {
+		thr.join();
+	}
+}
+
+static void
+reader()
+{
+	struct pollfd p[2] = {
+		{ STDIN_FILENO, POLLIN, 0 },
+		{ stop_pipe[0], POLLIN, 0 }
+	};
+
+	while (1) {
+		if (poll(p, 2, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			cerr(1, "input poll");
+		}
+
+		if (p[1].revents != 0) {
+			return;
+		}
+
+		if (p[0].revents == 0) {
+			continue;
+		}
+
+		int const key = be->get_key();
+
+		if (!push(key)) {
+			return;
+		}
+
+		/* nothing more will come, let the engine see the ERR */
+		if (key == ERR) {
+			return;
+		}
+	}
+}
+
+/* false if asked to stop while waiting for room */
+static bool
+push(int const key)
+{
+	std::size_t const h = head.load(std::memory_order_relaxed);
+
+	while (h - tail.load(std::memory_order_acquire) == RING_SIZE) {
+		struct pollfd p = { stop_pipe[0], POLLIN, 0 };
+
+		if (poll(&p, 1, 1) == 1) {
+			return false;
+		}
+	}
+
+	ring[h % RING_SIZE] = key;
+	head.store(h + 1, std::memory_order_release);
+
+	if (sem_post(&avail) == -1) {
+		cerr(1, "input sem_post");
+	}
+
+	return true;
+}
+
+static int
+pop()
+{
+	std::size_t const t = tail.load(std::memory_order_relaxed);
+
+	if (t == head.load(std::memory_order_acquire)) {
+		cerrx(1, "input ring empty");
+	}
+
+	int const key = ring[t % RING_SIZE];
+
+	tail.store(t + 1, std::memory_order_release);
+
+	return key;
+}
+
+/* pop a key counted by the semaphore */
+static int
+take()
+{
+	return consume(pop());
+}
+
+/* record a key the engine is about to act on and start timing it */
+static int
+consume(int const key)
+{
+	pending = true;
+	pending_at = steady::now();
+
+	record_key(key);
+
+	return key;
+}
+
+/* read the terminal, once any recording being replayed has run out */
+static void
+go_live()
+{
+	if (!thr.joinable()) {
+		thr = std::thread(reader);
+	}
+}
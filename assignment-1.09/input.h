@@ -0,0 +1,27 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <vector>
+
+#include "backend.h"
+#include "hist.h"
+
+/*
+ * Keys are read on their own thread and handed to the engine through a
+ * lock-free single-producer/single-consumer ring, so the engine thread can
+ * do other work while the player thinks. Only the engine thread may call
+ * input_wait() and input_poll().
+ */
+void	input_start(backend *const);
+void	input_stop();
+
+int	input_wait();
+bool	input_poll(int &);
+
+void	input_acted();
+void	input_next_floor();
+
+latency_hist const			&input_session_latency();
+std::vector<latency_hist> const		&input_floor_latency();
+
+#endif /* INPUT_H */
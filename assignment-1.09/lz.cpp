@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstring>
+
+#include "lz.h"
+
+static uint32_t	read32(uint8_t const *);
+static uint32_t	hash4(uint32_t const);
+static void	put_len(std::vector<uint8_t> &, std::size_t);
+static bool	get_len(uint8_t const *, std::size_t const, std::size_t &,
+	std::size_t &);
+static void	put_seq(std::vector<uint8_t> &, uint8_t const *,
+	std::size_t const, std::size_t const, std::size_t const);
+
+static std::size_t constexpr MIN_MATCH = 4;
+static std::size_t constexpr MAX_OFFSET = UINT16_MAX;
+static int constexpr HASH_BITS = 12;
+static uint8_t constexpr NIBBLE = 15;
+
+/* appends the packed form of in to out */
+void
+lz_pack(std::vector<uint8_t> &out, uint8_t const *const in,
+	std::size_t const n)
+{
+	/* last position + 1 each 4 byte prefix was seen at, 0 for never */
+	uint32_t seen[1 << HASH_BITS] = {};
+	std::size_t anchor = 0;
+	std::size_t i = 0;
+
+	while (n >= MIN_MATCH && i <= n - MIN_MATCH) {
+		uint32_t const v = read32(in + i);
+		uint32_t const h = hash4(v);
+		std::size_t const cand = seen[h];
+
+		seen[h] = (uint32_t)(i + 1);
+
+		if (cand == 0 || i + 1 - cand > MAX_OFFSET
+			|| read32(in + cand - 1) != v) {
+			i++;
+			continue;
+		}
+
+		std::size_t len = MIN_MATCH;
+
+		while (i + len < n && in[cand - 1 + len] == in[i + len]) {
+			len++;
+		}
+
+		put_seq(out, in + anchor, i - anchor, i + 1 - cand, len);
+
+		i += len;
+		anchor = i;
+	}
+
+	/* trailing literals, no match */
+	put_seq(out, in + anchor, n - anchor, 0, 0);
+}
+
+/* appends the unpacked form of in to out, false if in is malformed */
+bool
+lz_unpack(std::vector<uint8_t> &out, uint8_t const *const in,
+	std::size_t const n, std::size_t const max)
+{
+	std::size_t const base = out.size();
+	std::size_t i = 0;
+
+	while (i < n) {
+		uint8_t const tok = in[i++];
+		std::size_t lit = tok >> 4;
+
+		if (lit == NIBBLE && !get_len(in, n, i, lit)) {
+			return false;
+		}
+
+		if (lit > n - i || lit > max - (out.size() - base)) {
+			return false;
+		}
+
+		out.insert(out.end(), in + i, in + i + lit);
+		i += lit;
+
+		if (i == n) {
+			return true;
+		}
+
+		if (n - i < 2) {
+			return false;
+		}
+
+		std::size_t const off = (std::size_t)(in[i] | in[i + 1] << 8);
+		std::size_t len = tok & NIBBLE;
+
+		i += 2;
+
+		if (len == NIBBLE && !get_len(in, n, i, len)) {
+			return false;
+		}
+
+		len += MIN_MATCH;
+
+		if (off == 0 || off > out.size() - base
+			|| len > max - (out.size() - base)) {
+			return false;
+		}
+
+		/* byte at a time, the match may overlap what it produces */
+		std::size_t from = out.size() - off;
+
+		for (std::size_t k = 0; k < len; ++k) {
+			out.push_back(out[from++]);
+		}
+	}
+
+	/* only an empty input has no final token */
+	return n == 0;
+}
+
+static uint32_t
+read32(uint8_t const *const p)
+{
+	uint32_t v;
+
+	(void)std::memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+/* Knuth's multiplicative hash */
+static uint32_t
+hash4(uint32_t const v)
+{
+	return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/* the part of a length past its nibble, as a run of 255s and a remainder */
+static void
+put_len(std::vector<uint8_t> &out, std::size_t len)
+{
+	while (len >= UINT8_MAX) {
+		out.push_back(UINT8_MAX);
+		len -= UINT8_MAX;
+	}
+
+	out.push_back((uint8_t)len);
+}
+
+static bool
+get_len(uint8_t const *const in, std::size_t const n, std::size_t &i,
+	std::size_t &len)
+{
+	uint8_t b;
+
+	do {
+		if (i == n || len > SIZE_MAX / 2) {
+			return false;
+		}
+
+		b = in[i++];
+		len += b;
+	} while (b == UINT8_MAX);
+
+	return true;
+}
+
+/* literals, then a match unless len is 0 */
+static void
+put_seq(std::vector<uint8_t> &out, uint8_t const *const lit,
+	std::size_t const lit_len, std::size_t const off, std::size_t const len)
+{
+	std::size_t const m = len == 0 ? 0 : len - MIN_MATCH;
+
+	out.push_back((uint8_t)(std::min<std::size_t>(lit_len, NIBBLE) << 4
+		| std::min<std::size_t>(m, NIBBLE)));
+
+	if (lit_len >= NIBBLE) {
+		put_len(out, lit_len - NIBBLE);
+	}
+
+	out.insert(out.end(), lit, lit + lit_len);
+
+	if (len == 0) {
+		return;
+	}
+
+	out.push_back((uint8_t)(off & 0xFF));
+	out.push_back((uint8_t)(off >> 8));
+
+	if (m >= NIBBLE) {
+		put_len(out, m - NIBBLE);
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Byte-oriented LZ77 in the LZ4 mould: a token of literal and match
+ * lengths, the literals, then a 16 bit back offset. Fast rather than
+ * small, for data kept cold in memory or on disk. Unpacking checks every
+ * length and offset and stops at max bytes of output.
+ */
+void	lz_pack(std::vector<uint8_t> &, uint8_t const *, std::size_t const);
+bool	lz_unpack(std::vector<uint8_t> &, uint8_t const *, std::size_t const,
+	std::size_t const);
+
+#endif /* LZ_H */
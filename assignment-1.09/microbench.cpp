@@ -0,0 +1,670 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "cave.h"
+#include "cerr.h"
+#include "dijk.h"
+#include "gen.h"
+#include "globs.h"
+#include "npctab.h"
+#include "objtab.h"
+#include "parse.h"
+#include "ring.h"
+#include "turn.h"
+
+/*
+ * Timing harness for the engine's hot kernels. Every benchmark starts from
+ * the same seed, warms up while sizing a batch of runs that spans at least
+ * MIN_SAMPLE, then takes a number of batched samples and reports the median
+ * and median absolute deviation of the time per run.
+ */
+
+static int constexpr SOBEL_SIZE = 1024;
+static std::size_t constexpr CAVE_SIZE = CAVE_MAX;
+static unsigned int constexpr CAVE_ROCK = 115; /* floor.cpp's */
+
+extern "C" void	bench_sobel(uint8_t (*)[SOBEL_SIZE], uint8_t (*)[SOBEL_SIZE]);
+
+struct result {
+	std::string	name;
+	uint64_t	batch;
+	double		median; /* ns per run */
+	double		mad;
+};
+
+static void	usage(int const, std::string const &);
+static std::string	write_descs();
+static void	remove_descs(std::string const &);
+static void	reset_floor();
+static void	populate_floor();
+template<typename F> static void	measure(char const *const, F const &);
+static double	median(std::vector<double> &);
+static bool	check_dice();
+static double	cdf_error(uint64_t const, uint64_t const);
+static void	print_text();
+static void	print_json();
+
+static char const *const PROGRAM_NAME = "microbench";
+
+static unsigned long constexpr SEED = 3656437442;
+
+static auto constexpr WARMUP = std::chrono::milliseconds(50);
+static auto constexpr MIN_SAMPLE = std::chrono::milliseconds(1);
+
+static int constexpr LUMINANCE = 5; /* turn.cpp's default */
+
+/* --check-dice: rolls per spec, and the most the CDF may be off by */
+static std::size_t constexpr DICE_ROLLS = 1 << 18;
+static double constexpr DICE_CDF_ERROR = 1e-3;
+
+static int constexpr SYNTH_NPCS = 64;
+static int constexpr SYNTH_OBJS = 64;
+
+/* on the floor the snapshot ring copies */
+static int constexpr RING_NPCS = 16;
+static int constexpr RING_OBJS = 16;
+
+static char const *const colors[] = {
+	"BLACK", "BLUE", "CYAN", "GREEN", "MAGENTA", "RED", "WHITE", "YELLOW"
+};
+
+static char const *const abils[] = {
+	"SMART", "TELE", "TUNNEL", "ERRATIC", "SMART TELE", "TUNNEL ERRATIC",
+	"PASS", "SMART TELE TUNNEL ERRATIC"
+};
+
+static char const *const types[] = {
+	"WEAPON", "ARMOR", "RING", "FOOD", "WAND", "SCROLL", "LIGHT", "GOLD"
+};
+
+static struct option const long_opts[] = {
+	{"check-dice", no_argument, NULL, 'c'},
+	{"filter", required_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{"json", no_argument, NULL, 'j'},
+	{"samples", required_argument, NULL, 'n'},
+	{NULL, 0, NULL, 0}
+};
+
+static std::string only; /* --filter, "filter" is taken by ncurses */
+static unsigned long samples = 31;
+static std::vector<result> results;
+
+static dist_field field;
+static npc_heap heap;
+static uint8_t image[SOBEL_SIZE][SOBEL_SIZE];
+static uint8_t edges[SOBEL_SIZE][SOBEL_SIZE];
+static cave_grid cave;
+static cave_grid cave_next;
+
+/* keeps results of pure kernels alive */
+static uint64_t volatile sink;
+
+npc player;
+
+int
+main(int const argc, char *const argv[])
+{
+	std::string const name = (argc == 0) ? PROGRAM_NAME : argv[0];
+	bool json = false;
+	bool dice = false;
+	char *end;
+	int ch;
+
+	while ((ch = getopt_long(argc, argv, "cf:hjn:", long_opts, NULL))
+		!= -1) {
+		switch(ch) {
+		case 'c':
+			dice = true;
+			break;
+		case 'f':
+			only = optarg;
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS, name);
+			break;
+		case 'j':
+			json = true;
+			break;
+		case 'n':
+			samples = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || samples == 0) {
+				cerrx(1, "samples '%s' must be a positive number",
+					optarg);
+			}
+			break;
+		default:
+			usage(EXIT_FAILURE, name);
+		}
+	}
+
+	if (dice) {
+		return check_dice() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	std::string const dir = write_descs();
+
+	if (setenv("HOME", dir.c_str(), 1) == -1) {
+		cerr(1, "setenv HOME");
+	}
+
+	parse_npc_file();
+	parse_obj_file();
+
+	reset_floor();
+
+	measure("dijkstra/threaded", [] {
+		dijkstra();
+	});
+	measure("dijkstra/serial", [] {
+		(void)dist_compute(field, tiles, player.y, player.x, nullptr);
+	});
+	measure("dijkstra/speculative", [] {
+		spec_start(player.y, player.x);
+		if (!spec_commit(player.y, player.x)) {
+			dijkstra();
+		}
+	});
+
+	measure("fov/pc_viewbox", [] {
+		pc_viewbox(LUMINANCE);
+	});
+
+	measure("gen/clear_tiles", [] {
+		clear_tiles();
+	});
+	measure("gen/arrange_new", [] {
+		clear_tiles();
+		arrange_new();
+	});
+	measure("gen/arrange_new_fit", [] {
+		arrange_style(STYLE_FIT);
+		clear_tiles();
+		arrange_new();
+		arrange_style(STYLE_ROOMS);
+	});
+	measure("gen/arrange_new_caves", [] {
+		arrange_style(STYLE_CAVES);
+		clear_tiles();
+		arrange_new();
+		arrange_style(STYLE_ROOMS);
+	});
+
+	/* compiled once, as the parsers and the engine keep them */
+	static dice_sampler const d4(0, 1, 4);
+	static dice_sampler const d10(0, 10, 10);
+	static dice_sampler const d2(20, 1000, 2);
+
+	measure("dice/0+1d4", [] {
+		sink = rr.roll(d4);
+	});
+	measure("dice/0+10d10", [] {
+		sink = rr.roll(d10);
+	});
+	measure("dice/20+1000d2", [] {
+		sink = rr.roll(d2);
+	});
+
+	reset_floor();
+
+	measure("spawn/npc_template", [] {
+		sink = spawn_npc_template().value_or(0);
+	});
+	measure("spawn/obj_template", [] {
+		sink = spawn_obj_template().value_or(0);
+	});
+	measure("spawn/gen_npc", [] {
+		sink = gen_npc().has_value();
+	});
+
+	reset_floor();
+	populate_floor();
+
+	measure("ring/take", [] {
+		ring_take(heap);
+	});
+
+	ring_take(heap);
+
+	measure("ring/restore", [] {
+		sink = ring_restore(heap);
+	});
+
+	measure("parse/npc_file", [] {
+		npcs_parsed.clear();
+		parse_npc_file();
+	});
+	measure("parse/obj_file", [] {
+		objs_parsed.clear();
+		parse_obj_file();
+	});
+
+	rr = ranged_random(SEED);
+
+	for (auto &row : image) {
+		for (auto &px : row) {
+			px = rr.rrand<uint8_t>(0, 255);
+		}
+	}
+
+	measure("sobel/1024", [] {
+		bench_sobel(image, edges);
+	});
+
+	cave_init(cave, CAVE_SIZE, CAVE_SIZE);
+	cave_fill(cave, rr, CAVE_ROCK);
+
+	measure("cave/step_4096", [] {
+		cave_step(cave, cave_next);
+	});
+	measure("cave/grow_4096", [] {
+		cave_fill(cave, rr, CAVE_ROCK);
+
+		for (int i = 0; i < 4; ++i) {
+			cave_step(cave, cave_next);
+		}
+
+		sink = cave_connect(cave, 64, true);
+	});
+
+	remove_descs(dir);
+
+	if (json) {
+		print_json();
+	} else {
+		print_text();
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static void
+usage(int const status, std::string const &name)
+{
+	std::cout << "Usage: " << name << " [OPTION]... \n\n";
+
+	if (status != EXIT_SUCCESS) {
+		std::cerr << "Try '" << name <<
+			" --help' for more information.\n";
+	} else {
+		std::cout << "Time the engine's hot kernels.\n\n"
+			<< "Options:\n\
+  -c, --check-dice      check the normal approximation of large dice sums\n\
+                          against the exact sums and exit\n\
+  -f, --filter=[TEXT]   only run benchmarks whose name contains TEXT\n\
+  -h, --help            display this help text and exit\n\
+  -j, --json            print results as JSON\n\
+  -n, --samples=[NUM]   samples per benchmark (default 31)\n";
+	}
+
+	exit(status);
+}
+
+/* synthetic description files, the same on every run */
+static std::string
+write_descs()
+{
+	char tmpl[] = "/tmp/microbench.XXXXXX";
+
+	if (mkdtemp(tmpl) == NULL) {
+		cerr(1, "mkdtemp");
+	}
+
+	std::string const rlg = std::string(tmpl) + "/.rlg327";
+
+	if (mkdir(rlg.c_str(), 0700) == -1) {
+		cerr(1, "mkdir %s", rlg.c_str());
+	}
+
+	std::ofstream m(rlg + "/monster_desc.txt");
+
+	m << "RLG327 MONSTER DESCRIPTION 1\n";
+
+	for (int i = 0; i < SYNTH_NPCS; ++i) {
+		m << "\nBEGIN MONSTER\n"
+			<< "NAME Synthetic Monster " << i << '\n'
+			<< "SYMB " << static_cast<char>('a' + i % 26) << '\n'
+			<< "COLOR " << colors[i % 8] << ' '
+			<< colors[(i + 3) % 8] << '\n'
+			<< "DESC\n"
+			<< "Generated for the parser benchmark, number " << i
+			<< ".\nIt has no other purpose.\n.\n"
+			<< "SPEED " << 5 + i % 10 << "+1d" << 2 + i % 5 << '\n'
+			<< "DAM " << i % 3 << '+' << 1 + i % 4 << "d6\n"
+			<< "HP " << 10 + i << "+2d" << 4 + i % 8 << '\n'
+			<< "RRTY " << 1 + (i * 37) % 100 << '\n'
+			<< "ABIL " << abils[i % 8] << '\n'
+			<< "END\n";
+	}
+
+	std::ofstream o(rlg + "/object_desc.txt");
+
+	o << "RLG327 OBJECT DESCRIPTION 1\n";
+
+	for (int i = 0; i < SYNTH_OBJS; ++i) {
+		o << "\nBEGIN OBJECT\n"
+			<< "NAME Synthetic Object " << i << '\n'
+			<< "TYPE " << types[i % 8] << '\n'
+			<< "COLOR " << colors[(i + 1) % 8] << '\n'
+			<< "WEIGHT " << i % 7 << "+0d1\n"
+			<< "HIT 0+1d" << 2 + i % 6 << '\n'
+			<< "DAM 0+" << 1 + i % 3 << "d4\n"
+			<< "ATTR 0+0d1\n"
+			<< "VAL " << 10 * i << "+0d1\n"
+			<< "DODGE 0+0d1\n"
+			<< "DEF " << i % 5 << "+0d1\n"
+			<< "SPEED 0+0d1\n"
+			<< "DESC\n"
+			<< "Generated for the parser benchmark, number " << i
+			<< ".\n.\n"
+			<< "RRTY " << 1 + (i * 53) % 100 << '\n'
+			<< "ART " << (i % 16 == 0 ? "TRUE" : "FALSE") << '\n'
+			<< "END\n";
+	}
+
+	if (!m.flush() || !o.flush()) {
+		cerrx(1, "writing description files to %s", rlg.c_str());
+	}
+
+	return tmpl;
+}
+
+static void
+remove_descs(std::string const &dir)
+{
+	std::string const rlg = dir + "/.rlg327";
+
+	(void)unlink((rlg + "/monster_desc.txt").c_str());
+	(void)unlink((rlg + "/object_desc.txt").c_str());
+	(void)rmdir(rlg.c_str());
+	(void)rmdir(dir.c_str());
+}
+
+static void
+reset_floor()
+{
+	rr = ranged_random(SEED);
+	clear_tiles();
+	arrange_new();
+}
+
+/* NPCs and objects placed as turn_engine() spawns them, all heaped */
+static void
+populate_floor()
+{
+	npc_clear();
+	heap.clear();
+
+	for (int i = 0; i < RING_NPCS; ++i) {
+		std::optional<std::size_t> const pick = spawn_npc_template();
+		std::optional<std::pair<uint8_t, uint8_t>> const at = gen_npc();
+
+		if (!pick.has_value() || !at.has_value()) {
+			break;
+		}
+
+		npc_id const id = npc_new(npcs_parsed[*pick]);
+		npc &n = npc_get(id);
+
+		n.x = at->first;
+		n.y = at->second;
+		tiles[n.y][n.x].n = id;
+
+		heap.push_back(id);
+	}
+
+	for (int i = 0; i < RING_OBJS; ++i) {
+		std::optional<std::size_t> const pick = spawn_obj_template();
+		std::optional<std::pair<uint8_t, uint8_t>> const at = gen_obj();
+
+		if (!pick.has_value() || !at.has_value()) {
+			break;
+		}
+
+		tiles[at->second][at->first].o = obj_new(objs_parsed[*pick]);
+	}
+}
+
+template<typename F> static void
+measure(char const *const name, F const &f)
+{
+	using clock = std::chrono::steady_clock;
+
+	if (!only.empty() && std::string(name).find(only) == std::string::npos) {
+		return;
+	}
+
+	rr = ranged_random(SEED);
+
+	uint64_t batch = 1;
+	auto const warm_end = clock::now() + WARMUP;
+
+	/* warm up, doubling the batch until one sample spans MIN_SAMPLE */
+	for (;;) {
+		auto const start = clock::now();
+
+		for (uint64_t i = 0; i < batch; ++i) {
+			f();
+		}
+
+		auto const now = clock::now();
+
+		if (now - start < MIN_SAMPLE) {
+			batch *= 2;
+		} else if (now >= warm_end) {
+			break;
+		}
+	}
+
+	std::vector<double> per(samples);
+
+	for (auto &p : per) {
+		auto const start = clock::now();
+
+		for (uint64_t i = 0; i < batch; ++i) {
+			f();
+		}
+
+		std::chrono::duration<double, std::nano> const took =
+			clock::now() - start;
+
+		p = took.count() / static_cast<double>(batch);
+	}
+
+	double const med = median(per);
+
+	for (auto &p : per) {
+		p = std::abs(p - med);
+	}
+
+	results.push_back({ name, batch, med, median(per) });
+}
+
+static double
+median(std::vector<double> &v)
+{
+	std::size_t const mid = v.size() / 2;
+
+	std::nth_element(v.begin(), v.begin() + mid, v.end());
+
+	if (v.size() % 2 == 1) {
+		return v[mid];
+	}
+
+	double const hi = v[mid];
+
+	return (*std::max_element(v.begin(), v.begin() + mid) + hi) / 2;
+}
+
+static void
+print_text()
+{
+	std::cout << std::left << std::setw(24) << "benchmark" << std::right
+		<< std::setw(10) << "runs" << std::setw(16) << "median ns"
+		<< std::setw(14) << "mad ns" << '\n';
+
+	std::cout << std::fixed << std::setprecision(1);
+
+	for (auto const &r : results) {
+		std::cout << std::left << std::setw(24) << r.name << std::right
+			<< std::setw(10) << r.batch << std::setw(16) << r.median
+			<< std::setw(14) << r.mad << '\n';
+	}
+}
+
+/* one object per run, to be appended to a history and compared over time */
+static void
+print_json()
+{
+	std::cout << "{\n"
+		<< "  \"time\": " << std::time(nullptr) << ",\n"
+		<< "  \"seed\": " << SEED << ",\n"
+		<< "  \"samples\": " << samples << ",\n"
+		<< "  \"results\": [";
+
+	std::cout << std::fixed << std::setprecision(1);
+
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		result const &r = results[i];
+
+		std::cout << (i == 0 ? "\n" : ",\n")
+			<< "    {\"name\": \"" << r.name << "\", \"batch\": "
+			<< r.batch << ", \"median_ns\": " << r.median
+			<< ", \"mad_ns\": " << r.mad << "}";
+	}
+
+	std::cout << "\n  ]\n}\n";
+}
+
+/*
+ * Specs past the alias tables with enough dice to be drawn from a normal,
+ * checked for sampled mean and variance against n(m+1)/2 and n(m^2-1)/12
+ * within four standard errors, and for the distance between the rounded
+ * normal's CDF and that of the exact sum.
+ */
+static bool
+check_dice()
+{
+	static uint64_t const specs[][2] = {
+		{32, 200}, {100, 100}, {1000, 100}
+	};
+	bool ok = true;
+
+	rr = ranged_random(SEED);
+
+	std::cout << std::left << std::setw(10) << "dice"
+		<< std::right << std::setw(14) << "mean"
+		<< std::setw(14) << "expected"
+		<< std::setw(14) << "variance"
+		<< std::setw(14) << "expected"
+		<< std::setw(12) << "cdf error" << '\n';
+
+	for (auto const &sp : specs) {
+		double const n = static_cast<double>(sp[0]);
+		double const m = static_cast<double>(sp[1]);
+		double const mean = n * (m + 1) / 2;
+		double const var = n * (m * m - 1) / 12;
+		dice_sampler const d(0, sp[0], sp[1]);
+		double sum = 0;
+		double sq = 0;
+
+		for (std::size_t i = 0; i < DICE_ROLLS; ++i) {
+			double const v = static_cast<double>(rr.roll(d)) - mean;
+
+			sum += v;
+			sq += v * v;
+		}
+
+		double const rolls = static_cast<double>(DICE_ROLLS);
+		double const got_mean = mean + sum / rolls;
+		double const got_var = sq / rolls
+			- (sum / rolls) * (sum / rolls);
+		double const err = cdf_error(sp[0], sp[1]);
+
+		/* standard errors of the mean, and of a near normal variance */
+		bool const good = std::fabs(got_mean - mean)
+			<= 4 * std::sqrt(var / rolls)
+			&& std::fabs(got_var - var)
+			<= 4 * var * std::sqrt(2 / rolls)
+			&& err <= DICE_CDF_ERROR;
+
+		std::cout << std::left << std::setw(10)
+			<< (std::to_string(sp[0]) + "d" + std::to_string(sp[1]))
+			<< std::right << std::fixed << std::setprecision(2)
+			<< std::setw(14) << got_mean << std::setw(14) << mean
+			<< std::setw(14) << got_var << std::setw(14) << var
+			<< std::setw(12) << std::setprecision(6) << err
+			<< (good ? "" : "  FAIL") << '\n';
+
+		ok = ok && good;
+	}
+
+	return ok;
+}
+
+/*
+ * Largest gap between the CDF of the exact sum of the dice, convolved one
+ * die at a time with prefix sums, and that of the normal sample() draws
+ * from, rounded and clamped as it is.
+ */
+static double
+cdf_error(uint64_t const dice, uint64_t const sides)
+{
+	std::vector<double> p(1, 1);
+	std::vector<double> pre;
+
+	for (uint64_t i = 0; i < dice; ++i) {
+		std::vector<double> q(p.size() + sides - 1);
+
+		pre.assign(p.size() + 1, 0);
+
+		for (std::size_t j = 0; j < p.size(); ++j) {
+			pre[j + 1] = pre[j] + p[j];
+		}
+
+		for (std::size_t s = 0; s < q.size(); ++s) {
+			std::size_t const lo = s + 1 >= sides
+				? s + 1 - sides : 0;
+			std::size_t const hi = std::min(s, p.size() - 1);
+
+			q[s] = (pre[hi + 1] - pre[lo])
+				/ static_cast<double>(sides);
+		}
+
+		p.swap(q);
+	}
+
+	double const n = static_cast<double>(dice);
+	double const m = static_cast<double>(sides);
+	double const mean = n * (m + 1) / 2;
+	double const sd = std::sqrt(n * (m * m - 1) / 12);
+	double exact = 0;
+	double worst = 0;
+
+	/* p[i] is of a sum of dice + i; the top is certain once clamped */
+	for (std::size_t i = 0; i + 1 < p.size(); ++i) {
+		double const k = n + static_cast<double>(i);
+		double const approx = 0.5 * std::erfc(-(k + 0.5 - mean)
+			/ (sd * std::sqrt(2.0)));
+
+		exact += p[i];
+		worst = std::max(worst, std::fabs(exact - approx));
+	}
+
+	return worst;
+}
@@ -0,0 +1,49 @@
+#include <limits>
+#include <vector>
+
+#include "cerr.h"
+#include "npctab.h"
+
+static std::vector<npc> table;
+
+npc_id
+npc_new(npc const &n)
+{
+	if (table.size() >= std::numeric_limits<npc_id>::max() - NPC_FIRST) {
+		cerrx(1, "npc table full");
+	}
+
+	table.push_back(n);
+
+	return static_cast<npc_id>(table.size() - 1 + NPC_FIRST);
+}
+
+npc &
+npc_get(npc_id const id)
+{
+	return id == PC_ID ? player : table[id - NPC_FIRST];
+}
+
+/* n is the PC or lives in the table */
+npc_id
+npc_id_of(npc const &n)
+{
+	if (&n == &player) {
+		return PC_ID;
+	}
+
+	return static_cast<npc_id>(&n - table.data() + NPC_FIRST);
+}
+
+std::vector<npc> &
+npc_all()
+{
+	return table;
+}
+
+/* on leaving the floor */
+void
+npc_clear()
+{
+	table.clear();
+}
@@ -0,0 +1,22 @@
+#ifndef NPCTAB_H
+#define NPCTAB_H
+
+#include <vector>
+
+#include "globs.h"
+
+/*
+ * The NPCs of the floor being played, by value. Tiles and the turn heap
+ * hold ids, PC_ID for the PC, so the floor's state is flat and copies with
+ * no pointers to fix up. NPC id i is npc_all()[i - NPC_FIRST]. A reference
+ * from npc_get() is invalidated by the next npc_new().
+ */
+npc_id constexpr NPC_FIRST = PC_ID + 1;
+
+npc_id			npc_new(npc const &);
+npc			&npc_get(npc_id const);
+npc_id			npc_id_of(npc const &);
+std::vector<npc>	&npc_all();
+void			npc_clear();
+
+#endif /* NPCTAB_H */
@@ -0,0 +1,60 @@
+#include <limits>
+#include <vector>
+
+#include "cerr.h"
+#include "objtab.h"
+
+/* handle h lives at table[h - 1], leaving 0 for NO_OBJ */
+static std::vector<obj> table;
+static std::vector<obj_handle> free_handles;
+
+obj_handle
+obj_new(obj const &o)
+{
+	if (!free_handles.empty()) {
+		obj_handle const h = free_handles.back();
+		free_handles.pop_back();
+
+		table[h - 1] = o;
+		return h;
+	}
+
+	if (table.size() >= std::numeric_limits<obj_handle>::max()) {
+		cerrx(1, "object table full");
+	}
+
+	table.push_back(o);
+
+	return static_cast<obj_handle>(table.size());
+}
+
+void
+obj_free(obj_handle const h)
+{
+	if (h == NO_OBJ || h > table.size()) {
+		cerrx(1, "obj_free invalid handle %u", h);
+	}
+
+	free_handles.push_back(h);
+}
+
+obj &
+obj_get(obj_handle const h)
+{
+	return table[h - 1];
+}
+
+void
+obj_table_save(std::vector<obj> &objs, std::vector<obj_handle> &free_objs)
+{
+	objs = table;
+	free_objs = free_handles;
+}
+
+void
+obj_table_load(std::vector<obj> const &objs,
+	std::vector<obj_handle> const &free_objs)
+{
+	table = objs;
+	free_handles = free_objs;
+}
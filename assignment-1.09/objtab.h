@@ -0,0 +1,22 @@
+#ifndef OBJTAB_H
+#define OBJTAB_H
+
+#include <vector>
+
+#include "globs.h"
+
+/*
+ * Central object storage. The floor, carry bag and equipment slots hold
+ * handles, so moving an item between them never copies the object. A
+ * reference from obj_get() is invalidated by the next obj_new().
+ */
+obj_handle	obj_new(obj const &);
+void		obj_free(obj_handle const);
+obj		&obj_get(obj_handle const);
+
+/* the whole table, handles and all, for the snapshot ring, see ring.h */
+void		obj_table_save(std::vector<obj> &, std::vector<obj_handle> &);
+void		obj_table_load(std::vector<obj> const &,
+	std::vector<obj_handle> const &);
+
+#endif /* OBJTAB_H */
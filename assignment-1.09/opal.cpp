@@ -1,37 +1,78 @@
 #include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <thread>
 
 #include <getopt.h>
+#include <ncurses.h>
 
+#include "alloc.h"
+#include "backend.h"
+#include "cache.h"
 #include "cerr.h"
+#include "dijk.h"
 #include "gen.h"
 #include "globs.h"
+#include "input.h"
 #include "parse.h"
+#include "render.h"
+#include "replay.h"
+#include "ring.h"
+#include "search.h"
+#include "snap.h"
+#include "statehash.h"
+#include "stats.h"
+#include "trace.h"
 #include "turn.h"
 
 static void	usage(int const, std::string const &);
 
-static bool	colors();
+static void	print_latency(std::string const &);
+static void	linger();
 
-static void	print_deathscreen(WINDOW *const);
-static void	print_winscreen1(WINDOW *const);
-static void	print_winscreen2(WINDOW *const);
+static void	print_deathscreen();
+static void	print_winscreen1();
+static void	print_winscreen2();
 
 static bool	is_number(std::string const &);
 
 static char const *const PROGRAM_NAME = "opal";
 
+/* the PC's hit points, compiled once */
+static dice_sampler const PC_HP(50, 2, 50);
+
+/* replaying: skip the pauses around the final screens */
+static bool full_speed;
+
 static struct option const long_opts[] = {
+	{"allocs", no_argument, NULL, 'A'},
+	{"backend", required_argument, NULL, 'b'},
+	{"backend-stats", no_argument, NULL, 'B'},
+	{"cache", required_argument, NULL, 'c'},
 	{"nodescs", no_argument, NULL, 'd'},
+	{"find-seed", required_argument, NULL, 'F'},
+	{"fit-rooms", no_argument, NULL, 'f'},
+	{"caves", no_argument, NULL, 'g'},
+	{"hash-check", required_argument, NULL, 'C'},
 	{"help", no_argument, NULL, 'h'},
-	{"load", no_argument, NULL, 'l'},
+	{"hash", required_argument, NULL, 'H'},
+	{"latency", optional_argument, NULL, 'L'},
+	{"load", optional_argument, NULL, 'l'},
+	{"matches", required_argument, NULL, 'k'},
 	{"numnpcs", required_argument, NULL, 'n'},
 	{"numobjs", required_argument, NULL, 'o'},
+	{"record", required_argument, NULL, 'r'},
+	{"replay", required_argument, NULL, 'R'},
+	{"resume", no_argument, NULL, 'u'},
 	{"save", no_argument, NULL, 's'},
 	{"seed", required_argument, NULL, 'z'},
+	{"stats", no_argument, NULL, 'S'},
+	{"undo-every", required_argument, NULL, 'U'},
 	{NULL, 0, NULL, 0}
 };
 
@@ -40,26 +81,106 @@ npc player;
 int
 main(int const argc, char *const argv[])
 {
-	WINDOW *win;
+	std::unique_ptr<backend> be;
+	enum turn_exit ex;
+	std::string be_name = "curses";
 	char *end;
 	int ch;
 	bool load = false;
+	floor_style style = STYLE_ROOMS;
 	bool save = false;
 	bool no_descs = false;
+	bool be_stats = false;
+	bool latency = false;
+	bool stats = false;
+	bool allocs = false;
+	bool resume = false;
+	std::string record_path;
+	std::string replay_path;
+	std::string latency_path;
+	std::string load_path;
+	uint64_t load_floor = 0;
+	std::string find_expr;
+	uint64_t matches = 1;
 	unsigned int numnpcs = std::numeric_limits<unsigned int>::max();
 	unsigned int numobjs = std::numeric_limits<unsigned int>::max();
+	unsigned int undo_every = 1;
 	std::string const name = (argc == 0) ? PROGRAM_NAME : argv[0];
 
-	while ((ch = getopt_long(argc, argv, "dhln:o:sz:", long_opts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "Ab:Bc:C:dfF:ghH:k:l::L::n:o:r:R:sSuU:z:", long_opts, NULL)) != -1) {
 		switch(ch) {
+		case 'A':
+			allocs = true;
+			break;
+		case 'b':
+			be_name = optarg;
+			break;
+		case 'B':
+			be_stats = true;
+			break;
+		case 'c':
+			cache_budget(1024 * strtoul(optarg, &end, 10));
+
+			if (optarg == end || errno == EINVAL || errno == ERANGE) {
+				cerr(1, "cache size invalid");
+			}
+			break;
+		case 'C':
+			hash_check_open(optarg);
+			break;
 		case 'd':
 			no_descs = true;
 			break;
+		case 'f':
+			style = STYLE_FIT;
+			break;
+		case 'F':
+			find_expr = optarg;
+			break;
+		case 'g':
+			style = STYLE_CAVES;
+			break;
 		case 'h':
 			usage(EXIT_SUCCESS, name);
 			break;
+		case 'H':
+			hash_write_open(optarg);
+			break;
+		case 'k':
+			matches = strtoull(optarg, &end, 10);
+
+			if (optarg == end || errno == EINVAL || errno == ERANGE) {
+				cerr(1, "matches invalid");
+			}
+			break;
 		case 'l':
 			load = true;
+
+			/* FILE or FILE:N, floor N of an archive */
+			if (optarg != NULL) {
+				char const *const colon = strrchr(optarg, ':');
+
+				load_path = optarg;
+
+				if (colon != NULL) {
+					errno = 0;
+					load_path.resize((std::size_t)(colon - optarg));
+					load_floor = strtoull(colon + 1, &end, 10);
+
+					if (colon[1] == '\0' || *end != '\0'
+						|| errno == ERANGE) {
+						cerrx(1, "load floor %s invalid",
+							colon + 1);
+					}
+				}
+			}
+			break;
+		case 'L':
+			latency = true;
+
+			if (optarg != NULL) {
+				latency_path = optarg;
+			}
 			break;
 		case 'n':
 			numnpcs = (unsigned int)strtoul(optarg, &end, 10);
@@ -75,9 +196,28 @@ main(int const argc, char *const argv[])
 				cerr(1, "numobjs invalid");
 			}
 			break;
+		case 'r':
+			record_path = optarg;
+			break;
+		case 'R':
+			replay_path = optarg;
+			break;
 		case 's':
 			save = true;
 			break;
+		case 'S':
+			stats = true;
+			break;
+		case 'u':
+			resume = true;
+			break;
+		case 'U':
+			undo_every = (unsigned int)strtoul(optarg, &end, 10);
+
+			if (optarg == end || errno == EINVAL || errno == ERANGE) {
+				cerr(1, "undo-every invalid");
+			}
+			break;
 		case 'z':
 			if (is_number(optarg)) {
 				rr = ranged_random(strtoul(optarg, &end, 10));
@@ -95,6 +235,41 @@ main(int const argc, char *const argv[])
 		}
 	}
 
+	if (resume && (load || !record_path.empty() || !replay_path.empty())) {
+		cerrx(1, "resume can't be combined with load, record or replay");
+	}
+
+	/*
+	 * A recording brings its own seed and options. An old one doesn't
+	 * keep the archive it loaded, which -l may give.
+	 */
+	if (!replay_path.empty()) {
+		session_opts o;
+
+		o.load_path = load_path;
+		o.load_floor = load_floor;
+		replay_open(replay_path, o);
+
+		rr = ranged_random(o.seed);
+		numnpcs = o.numnpcs;
+		numobjs = o.numobjs;
+		no_descs = o.no_descs;
+		load = o.load;
+		load_path = o.load_path;
+		load_floor = o.load_floor;
+		style = o.style;
+		undo_every = o.undo_every;
+		full_speed = true;
+	}
+
+	/* as given, before any counts are drawn from rr */
+	session_opts const given = { rr.seed, numnpcs, numobjs, no_descs, load,
+		load_path, load_floor, style, undo_every };
+
+	if (!record_path.empty()) {
+		record_open(record_path, given);
+	}
+
 	if (numnpcs == std::numeric_limits<unsigned int>::max()) {
 		numnpcs = rr.rrand<unsigned int>(3, 5);
 	}
@@ -103,79 +278,88 @@ main(int const argc, char *const argv[])
 		numobjs = rr.rrand<unsigned int>(10, 15);
 	}
 
-	(void)initscr();
-
-	if (!colors()) {
-		cerrx(1, "color init");
-	}
-
-	/* requires colors initialized */
 	if (!no_descs) {
 		parse_npc_file();
 		parse_obj_file();
 	}
 
-	if (refresh() == ERR) {
-		cerrx(1, "refresh from initscr");
+	if (!find_expr.empty()) {
+		return search_seeds(find_expr, given, matches) ? EXIT_SUCCESS
+			: EXIT_FAILURE;
 	}
 
-	if ((win = newwin(HEIGHT, WIDTH, 0, 0)) == NULL) {
-		cerrx(1, "newwin");
+	/* the generator, counts and style come back as they were saved */
+	if (resume && !snap_load(numnpcs, numobjs, style)) {
+		cerrx(1, "resuming snapshot");
 	}
 
-	(void)box(win, 0, 0);
+	snap_init(numnpcs, numobjs, style);
+	ring_every(undo_every);
 
-	if (curs_set(0) == ERR) {
-		cerrx(1, "curs_set");
+	if ((be = backend_new(be_name)) == nullptr) {
+		cerrx(1, "unknown backend %s", be_name.c_str());
 	}
 
-	if (noecho() == ERR) {
-		cerrx(1, "noecho");
-	}
+	fb_init(be.get());
+	input_start(be.get());
+	fb_box(FB_VIEW, 0);
 
-	if (raw() == ERR) {
-		cerrx(1, "raw");
-	}
+	arrange_style(style);
 
-	if (keypad(win, true) == ERR) {
-		cerrx(1, "keypad");
-	}
+	/* resuming, the floor came with the snapshot */
+	if (!resume) {
+		clear_tiles();
+
+		if (load) {
+			bool const ok = load_path.empty() ? load_dungeon()
+				: load_archived(load_path, load_floor);
 
-	clear_tiles();
+			if (!ok) {
+				cerrx(1, "loading dungeon");
+			}
 
-	if (load) {
-		if (!load_dungeon()) {
-			cerrx(1, "loading dungeon");
+			arrange_loaded();
+		} else {
+			arrange_new();
 		}
+	}
 
-		arrange_loaded();
-	} else {
-		arrange_new();
+	if (!resume) {
+		dijkstra();
 	}
 
-	player.color = COLOR_PAIR(COLOR_YELLOW);
-	player.dam = {0, 1, 4};
-	player.hp = rr.rand_dice<uint64_t>(50, 2, 50);
-	player.speed = 10;
-	player.symb = PLAYER;
-	player.turn = 0;
-	player.type = PLAYER_TYPE;
+	arrange_ahead();
+
+	if (!resume) {
+		player.color = COLOR_PAIR(COLOR_YELLOW);
+		player.dam = {0, 1, 4};
+		player.hp = rr.roll(PC_HP);
+		player.speed = 10;
+		player.symb = PLAYER;
+		player.turn = 0;
+		player.type = PLAYER_TYPE;
+	}
 
 	retry:
-	switch(turn_engine(win, numnpcs, numobjs)) {
+	ex = turn_engine(numnpcs, numobjs);
+
+	switch(ex) {
 	case TURN_DEATH:
-		std::this_thread::sleep_for(std::chrono::seconds(1));
-		print_deathscreen(win);
-		std::this_thread::sleep_for(std::chrono::seconds(1));
+		fb_flush();
+		linger();
+		print_deathscreen();
+		linger();
 		break;
-	case TURN_NEXT:
-		if (werase(win) == ERR) {
-			cerrx(1, "arrange_renew erase");
-		}
+	case TURN_DOWN:
+	case TURN_UP:
+		input_next_floor();
+		stats_next_floor();
+		alloc_new_floor();
 
-		(void)box(win, 0, 0);
+		fb_erase(FB_VIEW);
+		fb_box(FB_VIEW, 0);
 
-		arrange_renew();
+		arrange_renew(ex == TURN_DOWN ? 1 : -1);
 
 		for (auto &n : npcs_parsed) {
 			if (n.type & BOSS) {
@@ -190,31 +374,52 @@ main(int const argc, char *const argv[])
 	case TURN_QUIT:
 		break;
 	case TURN_WIN:
-		std::this_thread::sleep_for(std::chrono::seconds(1));
+		fb_flush();
+		linger();
 		if (rr.rrand<int>(0, 1) == 0) {
-			print_winscreen1(win);
+			print_winscreen1();
 		} else {
-			print_winscreen2(win);
+			print_winscreen2();
 		}
-		std::this_thread::sleep_for(std::chrono::seconds(1));
+		linger();
 		break;
 	}
 
-	if (delwin(win) == ERR) {
-		cerrx(1, "delwin");
+	input_stop();
+	arrange_stop();
+	snap_stop();
+	record_close();
+	be.reset();
+
+	trace_write("trace.json");
+
+	std::cout << "seed: " << rr.seed << '\n';
+
+	if (be_stats) {
+		fb_stats const &st = fb_get_stats();
+
+		std::cout << "backend " << be_name << ": " << st.frames
+			<< " frames, " << st.cells << " cells, "
+			<< st.put_ns / 1000 << " us put, "
+			<< st.present_ns / 1000 << " us present\n";
+	}
+
+	if (latency) {
+		print_latency(latency_path);
 	}
 
-	if (endwin() == ERR) {
-		cerrx(1, "endwin");
+	if (stats) {
+		stats_print(std::cout);
 	}
 
-	std::cout << "seed: " << rr.seed << '\n';
+	bool const lean = !allocs || alloc_report(std::cout);
+	bool const same = hash_finish(std::cout);
 
 	if (save && !save_dungeon()) {
 		cerrx(1, "saving dungeon");
 	}
 
-	return EXIT_SUCCESS;
+	return same && lean ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static void
@@ -229,129 +434,142 @@ usage(int const status, std::string const &name)
 		std::cout << "OPAL's Playable Almost Indefectibly.\n\n"
 			<< "Traverse a generated dungeon.\n\n"
 			<< "Options:\n\
+  -A, --allocs          print heap allocations by phase and per PC turn, and\n\
+                          fail if a steady-state turn allocated; needs a\n\
+                          'make allocs' build\n\
+  -b, --backend=[NAME]  output to curses (default), ansi or null\n\
+  -B, --backend-stats   print frames drawn and time spent in the backend\n\
+  -c, --cache=[KB]      keep up to KB of floors left behind unpacked, packing\n\
+                          older ones (default 64)\n\
+  -C, --hash-check=[FILE]\n\
+                        compare per-turn state hashes against FILE and\n\
+                          report the first turn that differs\n\
   -d, --nodescs         don't parse description files\n\
+  -f, --fit-rooms       place rooms only where they fit, instead of retrying\n\
+                          random spots\n\
+  -F, --find-seed=[EXPR]\n\
+                        print the first seeds from SEED up whose first floor\n\
+                          meets EXPR, e.g. 'rooms>=8,stair_dist>60,boss>=1',\n\
+                          and exit; metrics are rooms, up, down, open,\n\
+                          stair_dist, pc_stair, hp, npcs, objs, boss, uniq\n\
+  -g, --caves           grow each floor as one cave instead of rooms and\n\
+                          corridors\n\
   -h, --help            display this help text and exit\n\
-  -l, --load            load dungeon file\n\
+  -H, --hash=[FILE]     write a state hash after every turn to FILE\n\
+  -k, --matches=[NUM]   seeds --find-seed looks for (default 1)\n\
+  -l, --load[=FILE[:N]] load dungeon file, or floor N (default 0) of an\n\
+                          archive FILE from opal-gen -a\n\
+  -L, --latency[=FILE]  print key to frame latency percentiles, or write\n\
+                          them to FILE\n\
   -n, --numnpcs=[NUM]   number of npcs per floor\n\
   -o, --numobjs=[NUM]   number of objs per floor\n\
+  -r, --record=[FILE]   record seed, options and keys to FILE\n\
+  -R, --replay=[FILE]   replay a recording at full speed; with -b null\n\
+                          it runs headless\n\
   -s, --save            save dungeon file\n\
+  -S, --stats           print engine event counters on exit\n\
+  -u, --resume          resume the last quick-save, taken in game with 'S'\n\
+  -U, --undo-every=[NUM]\n\
+                        keep the floor for 'U' every NUM PC turns, so undo\n\
+                          steps back up to NUM at a time (default 1, 0 for\n\
+                          no undo)\n\
   -z, --seed=[SEED]     set rand seed, takes integer or string\n";
 	}
 
 	exit(status);
 }
 
-static bool
-colors()
+static void
+linger()
 {
-	if (start_color() == ERR) {
-		return false;
+	if (!full_speed) {
+		std::this_thread::sleep_for(std::chrono::seconds(1));
 	}
+}
 
-	if (init_pair(COLOR_BLUE, COLOR_BLUE, COLOR_BLACK) == ERR) {
-		return false;
-	}
+/* session percentiles, then each floor's; to stdout if path is empty */
+static void
+print_latency(std::string const &path)
+{
+	std::ofstream f;
 
-	if (init_pair(COLOR_CYAN, COLOR_CYAN, COLOR_BLACK) == ERR) {
-		return false;
-	}
+	if (!path.empty()) {
+		f.open(path);
 
-	if (init_pair(COLOR_GREEN, COLOR_GREEN, COLOR_BLACK) == ERR) {
-		return false;
+		if (!f) {
+			cerr(1, "latency open %s", path.c_str());
+		}
 	}
 
-	if (init_pair(COLOR_MAGENTA, COLOR_MAGENTA, COLOR_BLACK) == ERR) {
-		return false;
-	}
+	std::ostream &os = path.empty() ? std::cout : f;
+	std::vector<latency_hist> const &floors = input_floor_latency();
 
-	if (init_pair(COLOR_RED, COLOR_RED, COLOR_BLACK) == ERR) {
-		return false;
-	}
+	hist_print(os, "latency", input_session_latency());
 
-	if (init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK) == ERR) {
-		return false;
-	}
+	for (std::size_t i = 0; i < floors.size(); ++i) {
+		std::string const label = "latency floor " + std::to_string(i + 1);
 
-	if (init_pair(COLOR_YELLOW, COLOR_YELLOW, COLOR_BLACK) == ERR) {
-		return false;
+		hist_print(os, label.c_str(), floors[i]);
 	}
-
-	return true;
 }
 
 static void
-print_deathscreen(WINDOW *const win)
+print_deathscreen()
 {
-	if (werase(win) == ERR) {
-		cerrx(1, "erase on deathscreen");
-	}
-
-	(void)box(win, 0, 0);
-	(void)mvwprintw(win, HEIGHT / 2 - 1, WIDTH / 4, "You're dead, Jim.");
-	(void)mvwprintw(win, HEIGHT / 2 + 0, WIDTH / 4,
+	fb_erase(FB_VIEW);
+	fb_box(FB_VIEW, 0);
+	fb_print(FB_VIEW, HEIGHT / 2 - 1, WIDTH / 4, 0,
+		"You're dead, Jim.");
+	fb_print(FB_VIEW, HEIGHT / 2 + 0, WIDTH / 4, 0,
 		"\t\t-- McCoy, stardate 3468.1");
-	(void)mvwprintw(win, HEIGHT / 2 + 2, WIDTH / 4,
+	fb_print(FB_VIEW, HEIGHT / 2 + 2, WIDTH / 4, 0,
 		"You've died. Game over.");
-	(void)mvwprintw(win, HEIGHT - 1, 2, "[ press any key to exit ]");
-
-	if (wrefresh(win) == ERR) {
-		cerrx(1, "wrefresh on deathscreen");
-	}
+	fb_print(FB_VIEW, HEIGHT - 1, 2, 0,
+		"[ press any key to exit ]");
 
-	(void)wgetch(win);
+	(void)fb_getch();
 }
 
 static void
-print_winscreen1(WINDOW *const win)
+print_winscreen1()
 {
-	if (werase(win) == ERR) {
-		cerrx(1, "erase on winscreen1");
-	}
-
-	(void)box(win, 0, 0);
-	(void)mvwprintw(win, HEIGHT / 2 - 3, WIDTH / 12,
+	fb_erase(FB_VIEW);
+	fb_box(FB_VIEW, 0);
+	fb_print(FB_VIEW, HEIGHT / 2 - 3, WIDTH / 12, 0,
 		"[War] is instinctive. But the insinct can be fought. We're human");
-	(void)mvwprintw(win, HEIGHT / 2 - 2, WIDTH / 12,
+	fb_print(FB_VIEW, HEIGHT / 2 - 2, WIDTH / 12, 0,
 		"beings with the blood of a million savage years on our hands! But we");
-	(void)mvwprintw(win, HEIGHT / 2 - 1, WIDTH / 12,
+	fb_print(FB_VIEW, HEIGHT / 2 - 1, WIDTH / 12, 0,
 		"can stop it. We can admit that we're killers ... but we're not going");
-	(void)mvwprintw(win, HEIGHT / 2 + 0, WIDTH / 12,
+	fb_print(FB_VIEW, HEIGHT / 2 + 0, WIDTH / 12, 0,
 		"to kill today. That's all it takes! Knowing that we're not going to");
-	(void)mvwprintw(win, HEIGHT / 2 + 1, WIDTH / 12, "kill today!");
-	(void)mvwprintw(win, HEIGHT / 2 + 2, WIDTH / 12,
+	fb_print(FB_VIEW, HEIGHT / 2 + 1, WIDTH / 12, 0,
+		"kill today!");
+	fb_print(FB_VIEW, HEIGHT / 2 + 2, WIDTH / 12, 0,
 		"\t\t-- Kirk, \"A Taste of Armageddon\", stardate 3193.0");
-	(void)mvwprintw(win, HEIGHT / 2 + 4, WIDTH / 12,
+	fb_print(FB_VIEW, HEIGHT / 2 + 4, WIDTH / 12, 0,
 		"The boss has been defeated. Game over.");
-	(void)mvwprintw(win, HEIGHT - 1, 2, "[ press any key to exit ]");
+	fb_print(FB_VIEW, HEIGHT - 1, 2, 0,
+		"[ press any key to exit ]");
 
-	if (wrefresh(win) == ERR) {
-		cerrx(1, "wrefresh on winscreen1");
-	}
-
-	(void)wgetch(win);
+	(void)fb_getch();
 }
 
 static void
-print_winscreen2(WINDOW *const win)
+print_winscreen2()
 {
-	if (werase(win) == ERR) {
-		cerrx(1, "erase on winscreen2");
-	}
-
-	(void)box(win, 0, 0);
-	(void)mvwprintw(win, HEIGHT / 2 - 1, WIDTH / 4,
+	fb_erase(FB_VIEW);
+	fb_box(FB_VIEW, 0);
+	fb_print(FB_VIEW, HEIGHT / 2 - 1, WIDTH / 4, 0,
 		"You're still half savage. But there is hope.");
-	(void)mvwprintw(win, HEIGHT / 2 + 0, WIDTH / 4,
+	fb_print(FB_VIEW, HEIGHT / 2 + 0, WIDTH / 4, 0,
 		"\t\t-- Metron, stardate 3046.2");
-	(void)mvwprintw(win, HEIGHT / 2 + 2, WIDTH / 4,
+	fb_print(FB_VIEW, HEIGHT / 2 + 2, WIDTH / 4, 0,
 		"The boss has been defeated. Game over.");
-	(void)mvwprintw(win, HEIGHT - 1, 2, "[ press any key to exit ]");
-
-	if (wrefresh(win) == ERR) {
-		cerrx(1, "wrefresh on winscreen2");
-	}
+	fb_print(FB_VIEW, HEIGHT - 1, 2, 0,
+		"[ press any key to exit ]");
 
-	(void)wgetch(win);
+	(void)fb_getch();
 }
 
 
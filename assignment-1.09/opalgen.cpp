@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arc.h"
+#include "cerr.h"
+#include "floor.h"
+#include "lz.h"
+#include "rlg.h"
+
+static void	usage(int const, std::string const &);
+static void	work();
+static void	write_floor(long unsigned int const, uint8_t const *,
+	std::size_t const);
+static uint64_t	parse_count(char const *const, char const *const);
+
+static char const *const PROGRAM_NAME = "opal-gen";
+
+/* floors a worker claims at once, and the unit of archive order */
+static uint64_t constexpr CHUNK = 256;
+
+static struct option const long_opts[] = {
+	{"archive", required_argument, NULL, 'a'},
+	{"compress", no_argument, NULL, 'c'},
+	{"count", required_argument, NULL, 'n'},
+	{"fit-rooms", no_argument, NULL, 'f'},
+	{"caves", no_argument, NULL, 'g'},
+	{"help", no_argument, NULL, 'h'},
+	{"jobs", required_argument, NULL, 'j'},
+	{"out", required_argument, NULL, 'o'},
+	{"seed", required_argument, NULL, 'z'},
+	{NULL, 0, NULL, 0}
+};
+
+static uint64_t count = 1000;
+static long unsigned int first;
+static floor_style style = STYLE_ROOMS;
+static bool compress;
+static std::string out_dir;
+static bool archive;
+
+static std::atomic<uint64_t> next_chunk;
+
+/* chunks go into the archive in order, each waits for the one before */
+static std::mutex arc_lock;
+static std::condition_variable arc_turn;
+static uint64_t arc_next;
+
+int
+main(int const argc, char *const argv[])
+{
+	std::string arc_path;
+	unsigned int jobs = std::thread::hardware_concurrency();
+	char *end;
+	int ch;
+	std::string const name = (argc == 0) ? PROGRAM_NAME : argv[0];
+
+	while ((ch = getopt_long(argc, argv, "a:cfghj:n:o:z:", long_opts, NULL)) != -1) {
+		switch(ch) {
+		case 'a':
+			arc_path = optarg;
+			break;
+		case 'c':
+			compress = true;
+			break;
+		case 'f':
+			style = STYLE_FIT;
+			break;
+		case 'g':
+			style = STYLE_CAVES;
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS, name);
+			break;
+		case 'j':
+			jobs = (unsigned int)parse_count(optarg, "jobs");
+			break;
+		case 'n':
+			count = parse_count(optarg, "count");
+			break;
+		case 'o':
+			out_dir = optarg;
+			break;
+		case 'z':
+			errno = 0;
+			first = strtoul(optarg, &end, 10);
+
+			if (optarg == end || *end != '\0' || errno == ERANGE) {
+				cerrx(1, "seed %s invalid", optarg);
+			}
+			break;
+		default:
+			usage(EXIT_FAILURE, name);
+		}
+	}
+
+	if (jobs == 0) {
+		jobs = 1;
+	}
+
+	if (!out_dir.empty() && mkdir(out_dir.c_str(), 0755) == -1
+		&& errno != EEXIST) {
+		cerr(1, "mkdir %s", out_dir.c_str());
+	}
+
+	if (!arc_path.empty()) {
+		arc_open(arc_path, count);
+		archive = true;
+	}
+
+	auto const start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+
+	for (unsigned int i = 0; i < jobs; ++i) {
+		workers.emplace_back(work);
+	}
+
+	for (auto &w : workers) {
+		w.join();
+	}
+
+	arc_close();
+
+	std::chrono::duration<double> const took =
+		std::chrono::steady_clock::now() - start;
+
+	std::cout << count << " floors in " << took.count() << " s on "
+		<< jobs << " threads, "
+		<< static_cast<double>(count) / took.count() << " floors/s\n";
+
+	return EXIT_SUCCESS;
+}
+
+static void
+usage(int const status, std::string const &name)
+{
+	std::cout << "Usage: " << name << " [OPTION]... \n\n";
+
+	if (status != EXIT_SUCCESS) {
+		std::cerr << "Try '" << name <<
+			" --help' for more information.\n";
+	} else {
+		std::cout << "Generate floors without playing them.\n\n"
+			<< "Floor i is the one a fresh generator seeded with\n"
+			<< "SEED + i builds, loadable with 'opal -l', or as\n"
+			<< "'opal --load=FILE:i' from an archive.\n\n"
+			<< "Options:\n\
+  -a, --archive=[FILE]  write every floor into one archive FILE\n\
+  -c, --compress        LZ pack archived floors where it makes them smaller\n\
+  -f, --fit-rooms       place rooms only where they fit, as opal -f\n\
+  -g, --caves           grow caves instead of rooms, as opal -g\n\
+  -h, --help            display this help text and exit\n\
+  -j, --jobs=[NUM]      threads to generate on (default all cores)\n\
+  -n, --count=[NUM]     number of floors (default 1000)\n\
+  -o, --out=[DIR]       write each floor to DIR/SEED.rlg327\n\
+  -z, --seed=[SEED]     first seed (default 0)\n";
+	}
+
+	exit(status);
+}
+
+static void
+work()
+{
+	std::unique_ptr<dungeon_floor> f(new dungeon_floor());
+	std::vector<uint8_t> buf;
+	std::vector<uint8_t> packed;
+	std::vector<std::size_t> ends;
+	std::vector<std::size_t> raws;
+
+	for (;;) {
+		uint64_t const k = next_chunk.fetch_add(1);
+		uint64_t const lo = k * CHUNK;
+
+		if (lo >= count) {
+			return;
+		}
+
+		uint64_t const hi = std::min(lo + CHUNK, count);
+
+		buf.clear();
+		ends.clear();
+		raws.clear();
+
+		for (uint64_t i = lo; i < hi; ++i) {
+			long unsigned int const seed = first + i;
+			ranged_random rng(seed);
+
+			std::size_t const from = buf.size();
+
+			clear_floor(*f, rng);
+			gen_floor(*f, rng, style);
+
+			rlg_encode(buf, *f);
+
+			std::size_t const raw = buf.size() - from;
+
+			if (!out_dir.empty()) {
+				write_floor(seed, buf.data() + from, raw);
+			}
+
+			/* archived as packed only if that is smaller */
+			if (archive && compress) {
+				packed.clear();
+				lz_pack(packed, buf.data() + from, raw);
+
+				if (packed.size() < raw) {
+					buf.resize(from);
+					buf.insert(buf.end(), packed.begin(),
+						packed.end());
+				}
+			}
+
+			ends.push_back(buf.size());
+			raws.push_back(raw);
+		}
+
+		if (!archive) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> l(arc_lock);
+
+		arc_turn.wait(l, [k] { return arc_next == k; });
+
+		std::size_t from = 0;
+
+		for (std::size_t i = 0; i < ends.size(); ++i) {
+			arc_add(buf.data() + from, ends[i] - from, raws[i]);
+			from = ends[i];
+		}
+
+		arc_next++;
+		arc_turn.notify_all();
+	}
+}
+
+static void
+write_floor(long unsigned int const seed, uint8_t const *const buf,
+	std::size_t const size)
+{
+	std::string const path = out_dir + "/" + std::to_string(seed)
+		+ ".rlg327";
+	int const fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd == -1) {
+		cerr(1, "open %s", path.c_str());
+	}
+
+	if (write(fd, buf, size) != (ssize_t)size) {
+		cerr(1, "write %s", path.c_str());
+	}
+
+	if (close(fd) == -1) {
+		cerr(1, "close %s", path.c_str());
+	}
+}
+
+static uint64_t
+parse_count(char const *const s, char const *const what)
+{
+	char *end;
+
+	errno = 0;
+
+	unsigned long long const n = strtoull(s, &end, 10);
+
+	if (s == end || *end != '\0' || errno == ERANGE) {
+		cerrx(1, "%s %s invalid", what, s);
+	}
+
+	return n;
+}
@@ -2,9 +2,11 @@
 
 #include <sys/stat.h>
 
+#include "alloc.h"
 #include "cerr.h"
 #include "gen.h"
 #include "globs.h"
+#include "trace.h"
 #include "y.tab.h"
 
 static char const *const NPC_FILE = "/monster_desc.txt";
@@ -54,6 +56,9 @@ constexpr static int const line_max = 77;
 void
 parse_npc_file()
 {
+	TRACE_SPAN("parse_npc_file");
+	ALLOC_PHASE(ALLOC_PARSE);
+
 	struct stat st;
 	std::string const path = rlg_path() + NPC_FILE;
 
@@ -84,6 +89,9 @@ parse_npc_file()
 void
 parse_obj_file()
 {
+	TRACE_SPAN("parse_obj_file");
+	ALLOC_PHASE(ALLOC_PARSE);
+
 	struct stat st;
 	std::string const path = rlg_path() + OBJ_FILE;
 
@@ -1,7 +1,17 @@
 #ifndef PARSE_H
 #define PARSE_H
 
+#include <vector>
+
+#include "rand.h"
+
 void	parse_npc_file();
 void	parse_obj_file();
 
+/*
+ * The dice rolled while parsing, so a seed search can draw the same values
+ * from its own generator instead of parsing again.
+ */
+extern std::vector<dice_sampler> parse_rolls;
+
 #endif /* PARSE_H */
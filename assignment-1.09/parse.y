@@ -2,23 +2,36 @@
 #include <cstring>
 #include <unordered_map>
 
+#include <ncurses.h>
+
 #include "cerr.h"
 #include "globs.h"
+#include "parse.h"
 
 extern int	yylex();
 
 static void	yyerror(char const *const);
 
-static dice	parse_dice(char *const);
+static dice_sampler	parse_dice(char *const);
 static uint64_t	parse_dice_value(char *const);
 static uint8_t	parse_rrty(char *const);
 
+static void	finish_npc();
+static void	finish_obj();
+
 bool in_n;
 bool in_o;
 
 npc c_npc;
 obj c_obj;
 
+/* every roll taken from rr, in order, see parse.h */
+std::vector<dice_sampler> parse_rolls;
+
+/* interned into c_npc or c_obj once the whole entry is read */
+static std::string c_desc;
+static std::string c_name;
+
 static std::unordered_map<std::string, int> const color_map = {
 	{"BLACK", COLOR_PAIR(COLOR_BLACK)},
 	{"BLUE", COLOR_PAIR(COLOR_BLUE)},
@@ -119,7 +132,7 @@ npcs
 	;
 
 npc
-	: BEGIN_NPC npc_keywords END
+	: BEGIN_NPC npc_keywords END	{ finish_npc(); }
 	;
 
 npc_keywords
@@ -150,7 +163,7 @@ objs
 	;
 
 obj
-	: BEGIN_OBJ obj_keywords END
+	: BEGIN_OBJ obj_keywords END	{ finish_obj(); }
 	;
 
 obj_keywords
@@ -179,14 +192,8 @@ obj_keyword
 	;
 
 name
-	: STR		{
-				if (in_n) c_npc.name += $1;
-				if (in_o) c_obj.name += $1;
-			}
-	| name STR	{
-				if (in_n) c_npc.name = c_npc.name + " " + $2;
-				if (in_o) c_obj.name = c_obj.name + " " + $2;
-			}
+	: STR		{ c_name += $1; }
+	| name STR	{ c_name = c_name + " " + $2; }
 	;
 
 color
@@ -198,14 +205,8 @@ color
 	;
 
 desc
-	: DESC_INNER		{
-					if (in_n) c_npc.desc += $1;
-					if (in_o) c_obj.desc += $1;
-				}
-	| desc DESC_INNER	{
-					if (in_n) c_npc.desc += $2;
-					if (in_o) c_obj.desc += $2;
-				}
+	: DESC_INNER		{ c_desc += $1; }
+	| desc DESC_INNER	{ c_desc += $2; }
 	;
 
 %%
@@ -217,10 +218,10 @@ yyerror(char const *const s)
 }
 
 
-static dice
+static dice_sampler
 parse_dice(char *const s)
 {
-	dice d;
+	uint64_t base, dice, sides;
 	char *p, *last;
 
 	p = strtok_r(s, "+", &last);
@@ -229,7 +230,7 @@ parse_dice(char *const s)
 		cerrx(1, "dice formatted incorrectly");
 	}
 
-	d.base = (uint64_t)std::atoll(p);
+	base = (uint64_t)std::atoll(p);
 
 	p = strtok_r(NULL, "d", &last);
 
@@ -237,7 +238,7 @@ parse_dice(char *const s)
 		cerrx(1, "dice formatted incorrectly");
 	}
 
-	d.dice = (uint64_t)std::atoll(p);
+	dice = (uint64_t)std::atoll(p);
 
 	p = strtok_r(NULL, "\0", &last);
 
@@ -245,16 +246,19 @@ parse_dice(char *const s)
 		cerrx(1, "dice format missing '+'");
 	}
 
-	d.sides = (uint64_t)std::atoll(p);
+	sides = (uint64_t)std::atoll(p);
 
-	return d;
+	return dice_sampler(base, dice, sides);
 }
 
 static uint64_t
 parse_dice_value(char *const s)
 {
-	dice const d = parse_dice(s);
-	return rr.rand_dice<uint64_t>(d.base, d.dice, d.sides);
+	dice_sampler const d = parse_dice(s);
+
+	parse_rolls.push_back(d);
+
+	return rr.roll(d);
 }
 
 static uint8_t
@@ -268,3 +272,27 @@ parse_rrty(char *const s)
 
 	return rrty;
 }
+
+static void
+finish_npc()
+{
+	c_npc.desc = str_intern(c_desc);
+	c_npc.name = str_intern(c_name);
+
+	npcs_parsed.push_back(c_npc);
+
+	c_desc.clear();
+	c_name.clear();
+}
+
+static void
+finish_obj()
+{
+	c_obj.desc = str_intern(c_desc);
+	c_obj.name = str_intern(c_name);
+
+	objs_parsed.push_back(c_obj);
+
+	c_desc.clear();
+	c_name.clear();
+}
@@ -1,3 +1,10 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 #include "rand.h"
 
 ranged_random rr;
@@ -25,3 +32,208 @@ ranged_random::ranged_random(long unsigned int const s)
 	seed = s;
 	gen.seed(seed);
 }
+
+/* one of many streams from a seed, each independent of how far rr has got */
+ranged_random::ranged_random(long unsigned int const s, uint64_t const stream)
+{
+	/* splitmix64 of the pair */
+	uint64_t z = s + (stream + 1) * 0x9E3779B97F4A7C15ULL;
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+
+	seed = s;
+	gen.seed(static_cast<uint32_t>(z ^ (z >> 32)));
+}
+
+/* at or below this many dice, rolling each die is cheaper than a lookup */
+static uint64_t constexpr DICE_LOOP_MAX = 4;
+/* largest sum range given an exact alias table */
+static uint64_t constexpr DICE_TABLE_MAX = 4096;
+/*
+ * Smallest dice count for which the normal approximation is used. Sums of
+ * uniform dice are symmetric, so the CDF's error is led by the kurtosis
+ * term, about 0.028 / dice whatever the sides: under 0.1% from here on.
+ * 'microbench --check-dice' checks it and the moments against exact sums.
+ */
+static uint64_t constexpr DICE_NORMAL_MIN = 32;
+
+struct alias_table {
+	std::vector<double>	prob;
+	std::vector<uint32_t>	alias;
+};
+
+static alias_table const	&intern_table(uint64_t const, uint64_t const);
+static void			build_table(alias_table &, uint64_t const,
+	uint64_t const);
+
+dice_sampler::dice_sampler(uint64_t const b, uint64_t const d,
+	uint64_t const s) : base(b), dice(d), sides(s)
+{
+	if (dice == 0 || sides == 0) {
+		k = DICE_CONST;
+		dice = 0;
+	} else if (sides == 1) {
+		k = DICE_CONST;
+	} else if (dice <= DICE_LOOP_MAX) {
+		k = DICE_LOOP;
+	} else if (dice <= DICE_TABLE_MAX / (sides - 1)
+		&& dice * (sides - 1) < DICE_TABLE_MAX) {
+		k = DICE_TABLE;
+		t = &intern_table(dice, sides);
+	} else if (dice >= DICE_NORMAL_MIN) {
+		/* sum of uniform [1, sides]: mean and variance add per die */
+		double const n = static_cast<double>(dice);
+		double const m = static_cast<double>(sides);
+		k = DICE_NORMAL;
+		mean = n * (m + 1) / 2;
+		sd = std::sqrt(n * (m * m - 1) / 12);
+	} else {
+		k = DICE_LOOP;
+	}
+}
+
+uint64_t
+dice_sampler::min() const
+{
+	return base + dice;
+}
+
+uint64_t
+dice_sampler::max() const
+{
+	return base + dice * std::max<uint64_t>(sides, 1);
+}
+
+uint64_t
+dice_sampler::sample(std::mt19937 &gen) const
+{
+	switch (k) {
+	case DICE_CONST:
+		return base + dice;
+	case DICE_LOOP: {
+		std::uniform_int_distribution<uint64_t> dis(1, sides);
+		uint64_t total = base;
+
+		for (uint64_t i = 0; i < dice; ++i) {
+			total += dis(gen);
+		}
+
+		return total;
+	}
+	case DICE_TABLE: {
+		std::uniform_int_distribution<std::size_t> col(0,
+			t->prob.size() - 1);
+		std::uniform_real_distribution<double> coin(0, 1);
+
+		std::size_t const i = col(gen);
+		uint64_t const off = coin(gen) < t->prob[i] ? i : t->alias[i];
+
+		return base + dice + off;
+	}
+	case DICE_NORMAL: {
+		std::normal_distribution<double> dis(mean, sd);
+		double const lo = static_cast<double>(dice);
+		double const hi = static_cast<double>(dice * sides);
+
+		return base + static_cast<uint64_t>(std::llround(
+			std::clamp(dis(gen), lo, hi)));
+	}
+	}
+
+	return base;
+}
+
+/*
+ * Tables depend only on the dice count and sides, so equal specifications
+ * share one. Nodes of std::map never move, so references stay valid.
+ */
+static alias_table const &
+intern_table(uint64_t const dice, uint64_t const sides)
+{
+	static std::map<std::pair<uint64_t, uint64_t>, alias_table> tables;
+	static std::mutex m;
+
+	std::lock_guard<std::mutex> lock(m);
+
+	auto const [it, fresh] = tables.try_emplace({dice, sides});
+
+	if (fresh) {
+		build_table(it->second, dice, sides);
+	}
+
+	return it->second;
+}
+
+/*
+ * Exact distribution of the sum by repeated convolution with one die, using
+ * a sliding window so each die costs O(range). The result is turned into a
+ * Vose alias table for O(1) sampling.
+ */
+static void
+build_table(alias_table &t, uint64_t const dice, uint64_t const sides)
+{
+	std::size_t const n = dice * (sides - 1) + 1;
+	std::vector<double> pmf(n, 0);
+	std::vector<double> next(n);
+
+	/* offsets from the minimum sum, which is one per die */
+	pmf[0] = 1;
+
+	for (uint64_t d = 1; d <= dice; ++d) {
+		std::size_t const reach = d * (sides - 1) + 1;
+		double window = 0;
+
+		for (std::size_t i = 0; i < reach; ++i) {
+			window += pmf[i];
+
+			if (i >= sides) {
+				window -= pmf[i - sides];
+			}
+
+			next[i] = window / static_cast<double>(sides);
+		}
+
+		std::swap(pmf, next);
+	}
+
+	t.prob.resize(n);
+	t.alias.resize(n);
+
+	std::vector<uint32_t> small;
+	std::vector<uint32_t> large;
+
+	for (std::size_t i = 0; i < n; ++i) {
+		t.prob[i] = pmf[i] * static_cast<double>(n);
+
+		if (t.prob[i] < 1) {
+			small.push_back(static_cast<uint32_t>(i));
+		} else {
+			large.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	while (!small.empty() && !large.empty()) {
+		uint32_t const s = small.back();
+		uint32_t const l = large.back();
+		small.pop_back();
+
+		t.alias[s] = l;
+		t.prob[l] = (t.prob[l] + t.prob[s]) - 1;
+
+		if (t.prob[l] < 1) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	/* leftovers differ from 1 only by rounding */
+	for (auto const i : small) {
+		t.prob[i] = 1;
+	}
+
+	for (auto const i : large) {
+		t.prob[i] = 1;
+	}
+}
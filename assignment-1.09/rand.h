@@ -1,9 +1,45 @@
 #ifndef RAND_H
 #define RAND_H
 
+#include <cstdint>
 #include <random>
 #include <string>
 
+struct alias_table;
+
+/*
+ * Compiled form of a "base+dicedsides" value. Few dice are rolled directly,
+ * sums with a small range are drawn from a precomputed alias table, and large
+ * dice counts use the normal approximation of the sum.
+ */
+class dice_sampler {
+	enum kind {
+		DICE_CONST,
+		DICE_LOOP,
+		DICE_TABLE,
+		DICE_NORMAL
+	};
+
+	kind			k = DICE_CONST;
+	alias_table const	*t = nullptr;
+	double			mean = 0;
+	double			sd = 0;
+
+public:
+	uint64_t	base = 0;
+	uint64_t	dice = 0;
+	uint64_t	sides = 0;
+
+	dice_sampler() = default;
+
+	dice_sampler(uint64_t const, uint64_t const, uint64_t const);
+
+	uint64_t	min() const;
+	uint64_t	max() const;
+
+	uint64_t	sample(std::mt19937 &) const;
+};
+
 class ranged_random {
 	std::mt19937 gen;
 public:
@@ -15,6 +51,8 @@ public:
 
 	explicit ranged_random(long unsigned int const);
 
+	ranged_random(long unsigned int const, uint64_t const);
+
 	template<typename T> T
 	rrand(T a, T b)
 	{
@@ -23,14 +61,21 @@ public:
 		return dis(gen);
 	}
 
-	template<typename T> T
-	rand_dice(T base, T dice, T sides)
+	/* a draw from a copy of the generator, which changes with its state */
+	uint64_t
+	fingerprint() const
+	{
+		std::mt19937 g = gen;
+		uint64_t const hi = g();
+
+		return hi << 32 | g();
+	}
+
+	/* keep the sampler; building one may intern a table */
+	uint64_t
+	roll(dice_sampler const &d)
 	{
-		T total = base;
-		for (size_t i = 0; i < dice; ++i) {
-			total = static_cast<T>(total + rrand<T>(1, sides));
-		}
-		return total;
+		return d.sample(gen);
 	}
 };
 
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+
+#include "alloc.h"
+#include "globs.h"
+#include "input.h"
+#include "render.h"
+#include "stats.h"
+#include "trace.h"
+
+struct cell {
+	uint32_t	g;
+	int		color;
+};
+
+static bool	same(cell const &, cell const &);
+static void	mark(int const, int const);
+static uint64_t	to_ns(std::chrono::steady_clock::duration const &);
+
+static int constexpr TABSIZE_FB = 8;
+
+static cell layers[2][HEIGHT][WIDTH];
+static cell shown[HEIGHT][WIDTH];
+
+/* dirty columns per row, clean when lo > hi */
+static int dirty_lo[HEIGHT];
+static int dirty_hi[HEIGHT];
+
+static backend *be;
+static fb_stats stats;
+
+void
+fb_init(backend *const b)
+{
+	be = b;
+	stats = {};
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			/* never equal to a real cell, forces the first flush */
+			shown[i][j] = { UINT32_MAX, 0 };
+		}
+	}
+
+	fb_erase(FB_VIEW);
+	fb_clear(FB_MENU);
+}
+
+void
+fb_put(fb_layer const l, int const y, int const x, uint32_t const g,
+	int const color)
+{
+	if (y < 0 || x < 0 || y >= HEIGHT || x >= WIDTH) {
+		return;
+	}
+
+	cell &c = layers[l][y][x];
+
+	if (c.g == g && c.color == color) {
+		return;
+	}
+
+	c = { g, color };
+	mark(y, x);
+}
+
+void
+fb_print(fb_layer const l, int y, int x, int const color,
+	char const *fmt, ...)
+{
+	char buf[WIDTH * 4];
+	va_list ap;
+
+	va_start(ap, fmt);
+	(void)vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	/* same tab and newline handling as waddch, but clipped, not wrapped */
+	for (char const *p = buf; *p != '\0'; ++p) {
+		if (*p == '\t') {
+			do {
+				fb_put(l, y, x++, ' ', color);
+			} while (x % TABSIZE_FB != 0);
+		} else if (*p == '\n') {
+			while (x < WIDTH) {
+				fb_put(l, y, x++, ' ', color);
+			}
+			y++;
+			x = 0;
+		} else {
+			fb_put(l, y, x++, (unsigned char)*p, color);
+		}
+	}
+}
+
+void
+fb_box(fb_layer const l, int const color)
+{
+	for (int i = 1; i < WIDTH - 1; ++i) {
+		fb_put(l, 0, i, G_HLINE, color);
+		fb_put(l, HEIGHT - 1, i, G_HLINE, color);
+	}
+
+	for (int i = 1; i < HEIGHT - 1; ++i) {
+		fb_put(l, i, 0, G_VLINE, color);
+		fb_put(l, i, WIDTH - 1, G_VLINE, color);
+	}
+
+	fb_put(l, 0, 0, G_ULCORNER, color);
+	fb_put(l, 0, WIDTH - 1, G_URCORNER, color);
+	fb_put(l, HEIGHT - 1, 0, G_LLCORNER, color);
+	fb_put(l, HEIGHT - 1, WIDTH - 1, G_LRCORNER, color);
+}
+
+/* fill with opaque blanks */
+void
+fb_erase(fb_layer const l)
+{
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			fb_put(l, i, j, ' ', 0);
+		}
+	}
+}
+
+/* make transparent, uncovering the view for the menu layer */
+void
+fb_clear(fb_layer const l)
+{
+	if (l == FB_VIEW) {
+		fb_erase(l);
+		return;
+	}
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			fb_put(l, i, j, G_NONE, 0);
+		}
+	}
+}
+
+void
+fb_flush()
+{
+	TRACE_SPAN("fb_flush");
+	ALLOC_PHASE(ALLOC_RENDER);
+
+	auto const start = std::chrono::steady_clock::now();
+	uint64_t const cells = stats.cells;
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = dirty_lo[i]; j <= dirty_hi[i]; ++j) {
+			cell const &m = layers[FB_MENU][i][j];
+			cell const &c = m.g != G_NONE ? m : layers[FB_VIEW][i][j];
+
+			if (same(c, shown[i][j])) {
+				continue;
+			}
+
+			shown[i][j] = c;
+			be->put(i, j, c.g, c.color);
+			stats.cells++;
+		}
+
+		dirty_lo[i] = WIDTH;
+		dirty_hi[i] = -1;
+	}
+
+	auto const put_done = std::chrono::steady_clock::now();
+
+	be->present();
+
+	stats.put_ns += to_ns(put_done - start);
+	stats.present_ns += to_ns(std::chrono::steady_clock::now() - put_done);
+	stats.frames++;
+	stat_add(STAT_CELLS_DRAWN, stats.cells - cells);
+
+	input_acted();
+}
+
+int
+fb_getch()
+{
+	fb_flush();
+
+	return input_wait();
+}
+
+fb_stats const &
+fb_get_stats()
+{
+	return stats;
+}
+
+static bool
+same(cell const &a, cell const &b)
+{
+	return a.g == b.g && a.color == b.color;
+}
+
+static void
+mark(int const y, int const x)
+{
+	dirty_lo[y] = std::min(dirty_lo[y], x);
+	dirty_hi[y] = std::max(dirty_hi[y], x);
+}
+
+static uint64_t
+to_ns(std::chrono::steady_clock::duration const &d)
+{
+	return static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
@@ -0,0 +1,56 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cstdint>
+
+#include "backend.h"
+
+/*
+ * Engine-side framebuffer of (glyph, color) cells. The dungeon view and the
+ * menu overlay are separate layers; menu cells other than G_NONE cover the
+ * view. fb_flush() sends only the cells that changed since the last flush.
+ */
+enum fb_layer {
+	FB_VIEW,
+	FB_MENU
+};
+
+/* glyphs outside the char range, mapped to line drawing when flushed */
+enum fb_glyph : uint32_t {
+	G_NONE = 0, /* transparent menu cell */
+	G_VLINE = 0x100,
+	G_HLINE,
+	G_ULCORNER,
+	G_URCORNER,
+	G_LLCORNER,
+	G_LRCORNER,
+	G_LTEE,
+	G_RTEE,
+	G_TTEE,
+	G_BTEE
+};
+
+/* backend traffic, to compare the cost of backends */
+struct fb_stats {
+	uint64_t	frames;
+	uint64_t	cells;
+	uint64_t	put_ns;
+	uint64_t	present_ns;
+};
+
+void	fb_init(backend *const);
+
+void	fb_put(fb_layer const, int const, int const, uint32_t const, int const);
+void	fb_print(fb_layer const, int const, int const, int const,
+	char const *, ...) __attribute__((format(printf, 5, 6)));
+void	fb_box(fb_layer const, int const);
+
+void	fb_erase(fb_layer const);
+void	fb_clear(fb_layer const);
+
+void	fb_flush();
+int	fb_getch();
+
+fb_stats const	&fb_get_stats();
+
+#endif /* RENDER_H */
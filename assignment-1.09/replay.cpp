@@ -0,0 +1,220 @@
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#include <endian.h>
+#undef _BSD_SOURCE
+#undef _DEFAULT_SOURCE
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "cerr.h"
+#include "floor.h"
+#include "replay.h"
+
+static char const MAGIC[8] = { 'O', 'P', 'A', 'L', 'R', 'E', 'C', '2' };
+/* before the undo interval and the archive loaded were kept */
+static char const MAGIC_V1[8] = { 'O', 'P', 'A', 'L', 'R', 'E', 'C', '1' };
+
+static uint8_t constexpr FLAG_NO_DESCS = 0x1;
+static uint8_t constexpr FLAG_LOAD = 0x2;
+static uint8_t constexpr FLAG_FIT_ROOMS = 0x4;
+static uint8_t constexpr FLAG_CAVES = 0x8;
+
+static std::size_t constexpr HEADER_SIZE = sizeof(MAGIC) + 8 + 4 + 4 + 1;
+/* the undo interval, floor and path length, followed by the path */
+static std::size_t constexpr V2_SIZE = 4 + 8 + 4;
+
+static FILE *rec;
+
+static std::vector<uint8_t> rep;
+static std::size_t rep_off;
+static bool rep_active;
+
+void
+record_open(std::string const &path, session_opts const &o)
+{
+	uint8_t hdr[HEADER_SIZE + V2_SIZE];
+	uint64_t const seed = htobe64(o.seed);
+	uint32_t const numnpcs = htobe32(o.numnpcs);
+	uint32_t const numobjs = htobe32(o.numobjs);
+	uint8_t const flags = (uint8_t)((o.no_descs ? FLAG_NO_DESCS : 0)
+		| (o.load ? FLAG_LOAD : 0)
+		| (o.style == STYLE_FIT ? FLAG_FIT_ROOMS : 0)
+		| (o.style == STYLE_CAVES ? FLAG_CAVES : 0));
+	uint32_t const undo_every = htobe32(o.undo_every);
+	uint64_t const load_floor = htobe64(o.load ? o.load_floor : 0);
+	std::string const arc = o.load ? o.load_path : "";
+
+	if (arc.size() > UINT32_MAX) {
+		cerrx(1, "record load path too long");
+	}
+
+	uint32_t const len = htobe32((uint32_t)arc.size());
+
+	if ((rec = fopen(path.c_str(), "wb")) == NULL) {
+		cerr(1, "record fopen %s", path.c_str());
+	}
+
+	(void)memcpy(hdr, MAGIC, sizeof(MAGIC));
+	(void)memcpy(hdr + 8, &seed, 8);
+	(void)memcpy(hdr + 16, &numnpcs, 4);
+	(void)memcpy(hdr + 20, &numobjs, 4);
+	hdr[24] = flags;
+	(void)memcpy(hdr + HEADER_SIZE, &undo_every, 4);
+	(void)memcpy(hdr + HEADER_SIZE + 4, &load_floor, 8);
+	(void)memcpy(hdr + HEADER_SIZE + 12, &len, 4);
+
+	if (fwrite(hdr, sizeof(hdr), 1, rec) != 1
+		|| fwrite(arc.data(), 1, arc.size(), rec) != arc.size()) {
+		cerr(1, "record header fwrite");
+	}
+}
+
+void
+record_key(int const key)
+{
+	/* ERR is -1, so every key is stored as key + 1 */
+	uint32_t v = (uint32_t)(key + 1);
+
+	if (rec == NULL) {
+		return;
+	}
+
+	do {
+		uint8_t const b = (uint8_t)((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+
+		if (putc(b, rec) == EOF) {
+			cerr(1, "record putc");
+		}
+
+		v >>= 7;
+	} while (v != 0);
+}
+
+void
+record_close()
+{
+	if (rec == NULL) {
+		return;
+	}
+
+	if (fclose(rec) == EOF) {
+		cerr(1, "record fclose");
+	}
+
+	rec = NULL;
+}
+
+/*
+ * Reads the whole file up front so replay runs at full speed. An OPALREC1
+ * file undoes every turn, as then, and leaves o's load path and floor as
+ * they are.
+ */
+void
+replay_open(std::string const &path, session_opts &o)
+{
+	FILE *f;
+	uint8_t buf[4096];
+	std::size_t n;
+	uint64_t seed, load_floor;
+	uint32_t numnpcs, numobjs, undo_every, len;
+
+	if ((f = fopen(path.c_str(), "rb")) == NULL) {
+		cerr(1, "replay fopen %s", path.c_str());
+	}
+
+	while ((n = fread(buf, 1, sizeof(buf), f)) != 0) {
+		rep.insert(rep.end(), buf, buf + n);
+	}
+
+	if (ferror(f)) {
+		cerr(1, "replay fread %s", path.c_str());
+	}
+
+	if (fclose(f) == EOF) {
+		cerr(1, "replay fclose");
+	}
+
+	bool const v1 = rep.size() >= sizeof(MAGIC_V1)
+		&& memcmp(rep.data(), MAGIC_V1, sizeof(MAGIC_V1)) == 0;
+
+	if (rep.size() < HEADER_SIZE + (v1 ? 0 : V2_SIZE)
+		|| (!v1 && memcmp(rep.data(), MAGIC, sizeof(MAGIC)) != 0)) {
+		cerrx(1, "%s is not a recording", path.c_str());
+	}
+
+	(void)memcpy(&seed, rep.data() + 8, 8);
+	(void)memcpy(&numnpcs, rep.data() + 16, 4);
+	(void)memcpy(&numobjs, rep.data() + 20, 4);
+
+	o.seed = be64toh(seed);
+	o.numnpcs = be32toh(numnpcs);
+	o.numobjs = be32toh(numobjs);
+	o.no_descs = rep[24] & FLAG_NO_DESCS;
+	o.load = rep[24] & FLAG_LOAD;
+	o.style = rep[24] & FLAG_CAVES ? STYLE_CAVES
+		: rep[24] & FLAG_FIT_ROOMS ? STYLE_FIT : STYLE_ROOMS;
+
+	o.undo_every = 1;
+
+	rep_off = HEADER_SIZE;
+
+	if (!v1) {
+		(void)memcpy(&undo_every, rep.data() + rep_off, 4);
+		(void)memcpy(&load_floor, rep.data() + rep_off + 4, 8);
+		(void)memcpy(&len, rep.data() + rep_off + 12, 4);
+		rep_off += V2_SIZE;
+
+		if (rep.size() - rep_off < be32toh(len)) {
+			cerrx(1, "%s is not a recording", path.c_str());
+		}
+
+		o.undo_every = be32toh(undo_every);
+		o.load_floor = be64toh(load_floor);
+		o.load_path.assign((char const *)rep.data() + rep_off,
+			be32toh(len));
+		rep_off += be32toh(len);
+	}
+
+	rep_active = true;
+}
+
+/* next recorded key; false once the recording is used up */
+bool
+replay_key(int &key)
+{
+	uint32_t v = 0;
+	int shift = 0;
+
+	if (!rep_active) {
+		return false;
+	}
+
+	while (1) {
+		if (rep_off == rep.size() || shift > 28) {
+			rep_active = false;
+			rep.clear();
+			return false;
+		}
+
+		uint8_t const b = rep[rep_off++];
+
+		v |= (uint32_t)(b & 0x7F) << shift;
+		shift += 7;
+
+		if ((b & 0x80) == 0) {
+			break;
+		}
+	}
+
+	key = (int)v - 1;
+
+	return true;
+}
+
+bool
+replaying()
+{
+	return rep_active;
+}
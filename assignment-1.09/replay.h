@@ -0,0 +1,39 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <string>
+
+/* as in floor.h, which brings all of globs.h */
+enum floor_style : uint8_t;
+
+/*
+ * With a fixed seed the game is deterministic apart from keys, so a session
+ * is its options plus every key the engine consumed. Files are an 8 byte
+ * magic, big-endian seed, npc and obj counts, a flags byte, the undo
+ * interval, the floor and path length of the archive loaded, its path,
+ * then each key plus one as an unsigned LEB128 varint. OPALREC1 files go
+ * from the flags to the keys.
+ */
+struct session_opts {
+	uint64_t	seed;
+	uint32_t	numnpcs;
+	uint32_t	numobjs;
+	bool		no_descs;
+	bool		load;
+	/* floor of an archive, or an empty path for the dungeon file */
+	std::string	load_path;
+	uint64_t	load_floor;
+	floor_style	style;
+	uint32_t	undo_every;	/* see ring_every() */
+};
+
+void	record_open(std::string const &, session_opts const &);
+void	record_key(int const);
+void	record_close();
+
+void	replay_open(std::string const &, session_opts &);
+bool	replay_key(int &);
+bool	replaying();
+
+#endif /* REPLAY_H */
@@ -0,0 +1,157 @@
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "alloc.h"
+#include "npctab.h"
+#include "objtab.h"
+#include "ring.h"
+#include "trace.h"
+
+struct ring_slot {
+	ranged_random		rng;
+	npc			pc;
+	obj_handle		items[PC_ITEMS];
+	std::vector<npc>	npcs;
+	npc_heap		heap;
+	std::vector<obj>	objs;
+	std::vector<obj_handle>	free_objs;
+	tile			t[HEIGHT][WIDTH];
+	uint64_t		pc_turn;
+};
+
+static void	capture(ring_slot &, npc_heap const &);
+static void	restore(ring_slot const &, npc_heap &);
+static void	drop();
+
+static_assert(std::is_trivially_copyable_v<tile>);
+
+static ring_slot slots[RING_SIZE];
+
+/* slots[newest] is the latest of count captures */
+static std::size_t newest;
+static std::size_t count;
+
+static unsigned int every = 1;
+
+/* PC turns begun on this floor, or since the capture restored */
+static uint64_t pc_turn;
+
+/*
+ * Capture every n PC turns, none if 0, so undo steps back up to n turns
+ * at a time over n times as many. 1 by default.
+ */
+void
+ring_every(unsigned int const n)
+{
+	every = n;
+}
+
+/* at the start of each PC turn, the PC off the heap */
+void
+ring_turn(npc_heap const &heap)
+{
+	if (every != 0 && pc_turn % every == 0) {
+		ring_take(heap);
+	}
+
+	pc_turn++;
+}
+
+/*
+ * Back to the start of the newest PC turn captured before this one, which
+ * is then played again, and captured again. False if there is none.
+ */
+bool
+ring_undo(npc_heap &heap)
+{
+	while (count != 0 && slots[newest].pc_turn + 1 >= pc_turn) {
+		drop();
+	}
+
+	if (!ring_restore(heap)) {
+		return false;
+	}
+
+	drop();
+
+	return true;
+}
+
+void
+ring_clear()
+{
+	count = 0;
+	pc_turn = 0;
+}
+
+void
+ring_take(npc_heap const &heap)
+{
+	newest = (newest + 1) % RING_SIZE;
+
+	if (count < RING_SIZE) {
+		count++;
+	}
+
+	capture(slots[newest], heap);
+}
+
+bool
+ring_restore(npc_heap &heap)
+{
+	if (count == 0) {
+		return false;
+	}
+
+	restore(slots[newest], heap);
+	pc_turn = slots[newest].pc_turn;
+
+	return true;
+}
+
+static void
+capture(ring_slot &s, npc_heap const &heap)
+{
+	TRACE_SPAN("ring_take");
+	ALLOC_PHASE(ALLOC_SAVE);
+
+	s.rng = rr;
+	s.pc = player;
+	pc_items(s.items);
+
+	s.npcs = npc_all();
+	s.heap = heap;
+	obj_table_save(s.objs, s.free_objs);
+
+	(void)std::memcpy(s.t, tiles, sizeof(s.t));
+
+	s.pc_turn = pc_turn;
+}
+
+/* the same floor's NPCs, so npc_all() keeps its storage */
+static void
+restore(ring_slot const &s, npc_heap &heap)
+{
+	TRACE_SPAN("ring_restore");
+
+	rr = s.rng;
+	player = s.pc;
+
+	npc_all() = s.npcs;
+	heap = s.heap;
+
+	/* before the items, which look their objects up */
+	obj_table_load(s.objs, s.free_objs);
+	pc_items_set(s.items);
+
+	(void)std::memcpy(tiles, s.t, sizeof(s.t));
+}
+
+static void
+drop()
+{
+	newest = (newest + RING_SIZE - 1) % RING_SIZE;
+	count--;
+}
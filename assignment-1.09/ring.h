@@ -0,0 +1,28 @@
+#ifndef RING_H
+#define RING_H
+
+#include <cstddef>
+
+#include "turn.h"
+
+/*
+ * The floor being played as it stood at the start of PC turns, one every
+ * ring_every() of them, the last RING_SIZE kept in memory: the generator,
+ * the PC and its items, the NPC and object tables, the turn heap and the
+ * tiles. All of it is flat, ids rather than pointers, so a capture or a
+ * restore is a few copies into buffers kept from the last time round. For
+ * undo, and for searches that play a line and back out. Other floors
+ * aren't kept; leaving one empties the ring.
+ */
+std::size_t constexpr RING_SIZE = 16;
+
+void	ring_every(unsigned int const);
+void	ring_turn(npc_heap const &);
+bool	ring_undo(npc_heap &);
+void	ring_clear();
+
+/* capture now, and go back to the newest capture, keeping it */
+void	ring_take(npc_heap const &);
+bool	ring_restore(npc_heap &);
+
+#endif /* RING_H */
@@ -0,0 +1,173 @@
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#include <endian.h>
+#undef _BSD_SOURCE
+#undef _DEFAULT_SOURCE
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "rlg.h"
+
+static uint8_t	*put(uint8_t *, void const *, std::size_t const);
+static uint8_t	*put16(uint8_t *, std::size_t const);
+template<typename T> static bool	take(uint8_t const *&,
+	uint8_t const *const, std::vector<T> &);
+
+static char const MARK[12] = { 'R', 'L', 'G', '3', '2', '7', '-', 'S', '2',
+	'0', '1', '9' };
+
+std::size_t
+rlg_size(dungeon_floor const &f)
+{
+	return RLG_HEADER + 2 + HEIGHT * WIDTH
+		+ 2 + f.rooms.size() * sizeof(room)
+		+ 2 + f.stairs_up.size() * sizeof(stair)
+		+ 2 + f.stairs_dn.size() * sizeof(stair);
+}
+
+/* appends f's file to out in one piece */
+void
+rlg_encode(std::vector<uint8_t> &out, dungeon_floor const &f)
+{
+	std::size_t const size = rlg_size(f);
+	uint32_t const ver = htobe32(0);
+	uint32_t const filesize = htobe32((uint32_t)size);
+
+	out.resize(out.size() + size);
+
+	uint8_t *p = out.data() + out.size() - size;
+
+	p = put(p, MARK, sizeof(MARK));
+	p = put(p, &ver, sizeof(ver));
+	p = put(p, &filesize, sizeof(filesize));
+
+	*p++ = f.pc_x;
+	*p++ = f.pc_y;
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			*p++ = f.t[i][j].h;
+		}
+	}
+
+	p = put16(p, f.rooms.size());
+	p = put(p, f.rooms.data(), f.rooms.size() * sizeof(room));
+
+	p = put16(p, f.stairs_up.size());
+	p = put(p, f.stairs_up.data(), f.stairs_up.size() * sizeof(stair));
+
+	p = put16(p, f.stairs_dn.size());
+	(void)put(p, f.stairs_dn.data(), f.stairs_dn.size() * sizeof(stair));
+}
+
+/*
+ * Fills f's terrain, rooms, stairs and PC spot from a whole file, reading
+ * in place. False if it isn't RLG327, is cut short, or puts anything off
+ * the floor.
+ */
+bool
+rlg_decode(dungeon_floor &f, uint8_t const *const buf, std::size_t const size)
+{
+	uint8_t const *const end = buf + size;
+
+	if (size < RLG_HEADER + 2 + HEIGHT * WIDTH
+		|| std::memcmp(buf, MARK, sizeof(MARK)) != 0) {
+		return false;
+	}
+
+	uint8_t const *p = buf + RLG_HEADER;
+
+	f.pc_x = *p++;
+	f.pc_y = *p++;
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			f.t[i][j].h = *p++;
+		}
+	}
+
+	if (!take(p, end, f.rooms) || !take(p, end, f.stairs_up)
+		|| !take(p, end, f.stairs_dn)) {
+		return false;
+	}
+
+	return rlg_fits(f);
+}
+
+bool
+rlg_inside(unsigned int const y, unsigned int const x)
+{
+	return y >= 1 && y < HEIGHT - 1u && x >= 1 && x < WIDTH - 1u;
+}
+
+/* f's PC spot, rooms and stairs all within the border */
+bool
+rlg_fits(dungeon_floor const &f)
+{
+	if (!rlg_inside(f.pc_y, f.pc_x)) {
+		return false;
+	}
+
+	for (auto const &r : f.rooms) {
+		if (r.size_x == 0 || r.size_y == 0 || !rlg_inside(r.y, r.x)
+			|| !rlg_inside(r.y + r.size_y - 1u,
+			r.x + r.size_x - 1u)) {
+			return false;
+		}
+	}
+
+	auto const off = [](stair const &s) { return !rlg_inside(s.y, s.x); };
+
+	return std::none_of(f.stairs_up.begin(), f.stairs_up.end(), off)
+		&& std::none_of(f.stairs_dn.begin(), f.stairs_dn.end(), off);
+}
+
+static uint8_t *
+put(uint8_t *const p, void const *const src, std::size_t const n)
+{
+	if (n != 0) {
+		(void)std::memcpy(p, src, n);
+	}
+
+	return p + n;
+}
+
+static uint8_t *
+put16(uint8_t *const p, std::size_t const n)
+{
+	uint16_t const be = htobe16((uint16_t)n);
+
+	return put(p, &be, sizeof(be));
+}
+
+/* a big-endian 16 bit count, then that many T */
+template<typename T> static bool
+take(uint8_t const *&p, uint8_t const *const end, std::vector<T> &v)
+{
+	uint16_t be;
+
+	if (end - p < (std::ptrdiff_t)sizeof(be)) {
+		return false;
+	}
+
+	(void)std::memcpy(&be, p, sizeof(be));
+	p += sizeof(be);
+
+	std::size_t const n = be16toh(be);
+
+	if ((std::size_t)(end - p) < n * sizeof(T)) {
+		return false;
+	}
+
+	v.resize(n);
+
+	if (n != 0) {
+		(void)std::memcpy(v.data(), p, n * sizeof(T));
+	}
+
+	p += n * sizeof(T);
+
+	return true;
+}
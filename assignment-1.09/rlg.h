@@ -0,0 +1,25 @@
+#ifndef RLG_H
+#define RLG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "floor.h"
+
+/*
+ * The RLG327-S2019 dungeon file: marker, version and size, the PC's
+ * coordinates, hardness row by row, then rooms, up and down stairs, each
+ * after a big-endian 16 bit count.
+ */
+std::size_t constexpr RLG_HEADER = 12 + 2 * sizeof(uint32_t);
+
+std::size_t	rlg_size(dungeon_floor const &);
+void		rlg_encode(std::vector<uint8_t> &, dungeon_floor const &);
+bool		rlg_decode(dungeon_floor &, uint8_t const *, std::size_t const);
+
+/* within the border, where the PC, rooms, stairs and things must be */
+bool		rlg_inside(unsigned int const, unsigned int const);
+bool		rlg_fits(dungeon_floor const &);
+
+#endif /* RLG_H */
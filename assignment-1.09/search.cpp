@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "cerr.h"
+#include "dijk.h"
+#include "floor.h"
+#include "parse.h"
+#include "search.h"
+#include "spawn.h"
+
+enum metric {
+	M_BOSS,
+	M_DOWN,
+	M_HP,
+	M_NPCS,
+	M_OBJS,
+	M_OPEN,
+	M_PC_STAIR,
+	M_ROOMS,
+	M_STAIR_DIST,
+	M_UNIQ,
+	M_UP,
+	M_COUNT
+};
+
+enum cmp {
+	CMP_EQ,
+	CMP_GE,
+	CMP_GT,
+	CMP_LE,
+	CMP_LT,
+	CMP_NE
+};
+
+struct term {
+	metric	m;
+	cmp	c;
+	int64_t	v;
+};
+
+struct match {
+	uint64_t	seed;
+	int64_t		v[M_COUNT];
+};
+
+static void	parse_expr(std::string const &);
+static void	work();
+static void	measure(uint64_t const, dungeon_floor &, dist_field &,
+	int64_t (&)[M_COUNT]);
+static void	spawn(dungeon_floor const &, ranged_random &,
+	unsigned int const, unsigned int const, int64_t (&)[M_COUNT]);
+static int64_t	stair_dist(dungeon_floor const &, dist_field &, uint8_t const,
+	uint8_t const);
+static bool	holds(term const &, int64_t const (&)[M_COUNT]);
+
+static struct {
+	char const	*name;
+	bool		spawns; /* needs the spawn phase run */
+} const metrics[M_COUNT] = {
+	{"boss", true},
+	{"down", false},
+	{"hp", true},
+	{"npcs", true},
+	{"objs", true},
+	{"open", false},
+	{"pc_stair", false},
+	{"rooms", false},
+	{"stair_dist", false},
+	{"uniq", true},
+	{"up", false}
+};
+
+/* longest first, so "<=" isn't read as "<" */
+static struct {
+	char const	*s;
+	cmp		c;
+} const cmps[] = {
+	{"==", CMP_EQ},
+	{">=", CMP_GE},
+	{"<=", CMP_LE},
+	{"!=", CMP_NE},
+	{">", CMP_GT},
+	{"<", CMP_LT}
+};
+
+/* seeds a worker claims at once */
+static uint64_t constexpr CHUNK = 64;
+
+static std::vector<term> terms;
+static session_opts opts;
+static uint64_t want;
+static bool need_dist;
+static bool need_spawn;
+
+/* the PC's hit points, built once and shared read-only by the workers */
+static dice_sampler hp_dice;
+
+static std::atomic<uint64_t> next_chunk;
+static std::atomic<uint64_t> scanned;
+static std::atomic<bool> enough;
+
+static std::mutex found_lock;
+static std::vector<match> found;
+
+/*
+ * Chunks are claimed in order and every claimed chunk is finished, so once
+ * k matches are in, every seed below the k lowest has been tried.
+ */
+bool
+search_seeds(std::string const &expr, session_opts const &o, uint64_t const k)
+{
+	unsigned int const jobs =
+		std::max(std::thread::hardware_concurrency(), 1u);
+
+	if (o.load) {
+		cerrx(1, "find-seed can't search a loaded dungeon");
+	}
+
+	opts = o;
+	want = std::max<uint64_t>(k, 1);
+
+	parse_expr(expr);
+
+	if (need_spawn && opts.no_descs) {
+		cerrx(1, "find-seed spawn terms need descriptions");
+	}
+
+	hp_dice = dice_sampler(50, 2, 50);
+
+	auto const start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+
+	for (unsigned int i = 0; i < jobs; ++i) {
+		workers.emplace_back(work);
+	}
+
+	for (auto &w : workers) {
+		w.join();
+	}
+
+	std::chrono::duration<double> const took =
+		std::chrono::steady_clock::now() - start;
+
+	std::sort(found.begin(), found.end(),
+		[](match const &a, match const &b) { return a.seed < b.seed; });
+
+	if (found.size() > want) {
+		found.resize(want);
+	}
+
+	for (auto const &m : found) {
+		std::cout << "seed " << m.seed << ':';
+
+		for (auto const &t : terms) {
+			std::cout << ' ' << metrics[t.m].name << '=' << m.v[t.m];
+		}
+
+		std::cout << '\n';
+	}
+
+	std::cout << found.size() << " of " << want << " matches in "
+		<< scanned.load() << " seeds, " << took.count() << " s on "
+		<< jobs << " threads\n";
+
+	return found.size() == want;
+}
+
+/* comma separated terms of a metric, a comparison and a number */
+static void
+parse_expr(std::string const &expr)
+{
+	std::size_t from = 0;
+
+	for (;;) {
+		std::size_t const to = std::min(expr.find(',', from), expr.size());
+		std::string const s = expr.substr(from, to - from);
+		std::size_t i = 0;
+		std::size_t j;
+		term t;
+		char *end;
+
+		while (i < s.size() && s[i] == ' ') {
+			i++;
+		}
+
+		for (j = i; j < s.size() && (s[j] == '_'
+			|| (s[j] >= 'a' && s[j] <= 'z')); ++j);
+
+		std::string const name = s.substr(i, j - i);
+		auto const m = std::find_if(std::begin(metrics), std::end(metrics),
+			[&name](auto const &e) { return name == e.name; });
+
+		if (m == std::end(metrics)) {
+			cerrx(1, "find-seed metric '%s' unknown", name.c_str());
+		}
+
+		t.m = static_cast<metric>(m - std::begin(metrics));
+
+		while (j < s.size() && s[j] == ' ') {
+			j++;
+		}
+
+		auto const c = std::find_if(std::begin(cmps), std::end(cmps),
+			[&s, j](auto const &e) {
+				return s.compare(j, std::strlen(e.s), e.s) == 0;
+			});
+
+		if (c == std::end(cmps)) {
+			cerrx(1, "find-seed term '%s' lacks a comparison",
+				s.c_str());
+		}
+
+		t.c = c->c;
+		j += std::strlen(c->s);
+
+		errno = 0;
+		t.v = std::strtoll(s.c_str() + j, &end, 10);
+
+		if (end == s.c_str() + j || errno == ERANGE) {
+			cerrx(1, "find-seed term '%s' lacks a number", s.c_str());
+		}
+
+		while (*end == ' ') {
+			end++;
+		}
+
+		if (*end != '\0') {
+			cerrx(1, "find-seed term '%s' invalid", s.c_str());
+		}
+
+		need_spawn |= metrics[t.m].spawns;
+		need_dist |= t.m == M_STAIR_DIST || t.m == M_PC_STAIR;
+
+		terms.push_back(t);
+
+		if (to == expr.size()) {
+			break;
+		}
+
+		from = to + 1;
+	}
+}
+
+static void
+work()
+{
+	std::unique_ptr<dungeon_floor> f(new dungeon_floor());
+	std::unique_ptr<dist_field> d(new dist_field());
+	std::vector<match> mine;
+
+	while (!enough.load(std::memory_order_relaxed)) {
+		uint64_t const lo = next_chunk.fetch_add(1) * CHUNK;
+
+		if (lo >= SEARCH_MAX) {
+			return;
+		}
+
+		uint64_t const hi = std::min(lo + CHUNK, SEARCH_MAX);
+
+		mine.clear();
+
+		for (uint64_t i = lo; i < hi; ++i) {
+			match m = { opts.seed + i, {} };
+
+			measure(m.seed, *f, *d, m.v);
+
+			if (std::all_of(terms.begin(), terms.end(),
+				[&m](term const &t) { return holds(t, m.v); })) {
+				mine.push_back(m);
+			}
+		}
+
+		scanned += hi - lo;
+
+		std::lock_guard<std::mutex> const l(found_lock);
+
+		found.insert(found.end(), mine.begin(), mine.end());
+
+		if (found.size() >= want) {
+			enough = true;
+		}
+	}
+}
+
+/* draw from a fresh generator in the order opal's main() and engine do */
+static void
+measure(uint64_t const seed, dungeon_floor &f, dist_field &d,
+	int64_t (&v)[M_COUNT])
+{
+	ranged_random rng(seed);
+	unsigned int numnpcs = opts.numnpcs;
+	unsigned int numobjs = opts.numobjs;
+
+	if (numnpcs == std::numeric_limits<unsigned int>::max()) {
+		numnpcs = rng.rrand<unsigned int>(3, 5);
+	}
+
+	if (numobjs == std::numeric_limits<unsigned int>::max()) {
+		numobjs = rng.rrand<unsigned int>(10, 15);
+	}
+
+	if (!opts.no_descs) {
+		for (auto const &r : parse_rolls) {
+			(void)rng.roll(r);
+		}
+	}
+
+	clear_floor(f, rng);
+	gen_floor(f, rng, opts.style);
+
+	v[M_ROOMS] = (int64_t)f.rooms.size();
+	v[M_UP] = (int64_t)f.stairs_up.size();
+	v[M_DOWN] = (int64_t)f.stairs_dn.size();
+
+	for (int i = 1; i < HEIGHT - 1; ++i) {
+		for (int j = 1; j < WIDTH - 1; ++j) {
+			v[M_OPEN] += f.t[i][j].h == 0;
+		}
+	}
+
+	if (need_dist) {
+		v[M_PC_STAIR] = stair_dist(f, d, f.pc_y, f.pc_x);
+		v[M_STAIR_DIST] = std::numeric_limits<int32_t>::max();
+
+		for (auto const &s : f.stairs_up) {
+			v[M_STAIR_DIST] = std::min(v[M_STAIR_DIST],
+				stair_dist(f, d, s.y, s.x));
+		}
+	}
+
+	if (need_spawn) {
+		v[M_HP] = (int64_t)rng.roll(hp_dice);
+
+		spawn(f, rng, numnpcs, numobjs, v);
+	}
+}
+
+/* as spawn_npcs() and spawn_objs() do on a floor of its own */
+static void
+spawn(dungeon_floor const &f, ranged_random &rng, unsigned int const numnpcs,
+	unsigned int const numobjs, int64_t (&v)[M_COUNT])
+{
+	bool has_npc[HEIGHT][WIDTH] = {};
+	bool has_obj[HEIGHT][WIDTH] = {};
+	std::vector<bool> npc_done(npcs_parsed.size());
+	std::vector<bool> obj_done(objs_parsed.size());
+
+	for (std::size_t i = 0; i < npcs_parsed.size(); ++i) {
+		npc_done[i] = npcs_parsed[i].done;
+	}
+
+	for (std::size_t i = 0; i < objs_parsed.size(); ++i) {
+		obj_done[i] = objs_parsed[i].done;
+	}
+
+	has_npc[f.pc_y][f.pc_x] = true;
+
+	for (unsigned int j = 0; j < numnpcs; ++j) {
+		std::optional<std::size_t> const pick = spawn_pick(npcs_parsed,
+			[&npc_done](std::size_t const i) { return npc_done[i]; },
+			rng);
+
+		if (!pick.has_value()) {
+			break;
+		}
+
+		std::optional<std::pair<uint8_t, uint8_t>> const coords =
+			spawn_spot(f.t, f.pc_x, f.pc_y,
+			[&has_npc](uint8_t const y, uint8_t const x) {
+				return has_npc[y][x];
+			}, rng);
+
+		if (!coords.has_value()) {
+			break;
+		}
+
+		npc const &n = npcs_parsed[*pick];
+
+		if (n.type & UNIQ) {
+			npc_done[*pick] = true;
+			v[M_UNIQ]++;
+		}
+
+		if (n.type & BOSS) {
+			v[M_BOSS]++;
+		}
+
+		has_npc[coords->second][coords->first] = true;
+		v[M_NPCS]++;
+	}
+
+	for (unsigned int j = 0; j < numobjs; ++j) {
+		std::optional<std::size_t> const pick = spawn_pick(objs_parsed,
+			[&obj_done](std::size_t const i) { return obj_done[i]; },
+			rng);
+
+		if (!pick.has_value()) {
+			break;
+		}
+
+		std::optional<std::pair<uint8_t, uint8_t>> const coords =
+			spawn_spot(f.t, f.pc_x, f.pc_y,
+			[&has_obj](uint8_t const y, uint8_t const x) {
+				return has_obj[y][x];
+			}, rng);
+
+		if (!coords.has_value()) {
+			break;
+		}
+
+		if (objs_parsed[*pick].art) {
+			obj_done[*pick] = true;
+		}
+
+		has_obj[coords->second][coords->first] = true;
+		v[M_OBJS]++;
+	}
+}
+
+/* d distance from (y, x) to the nearest down stair */
+static int64_t
+stair_dist(dungeon_floor const &f, dist_field &d, uint8_t const y,
+	uint8_t const x)
+{
+	int64_t best = std::numeric_limits<int32_t>::max();
+
+	dist_walk(d.d, f.t, y, x);
+
+	for (auto const &s : f.stairs_dn) {
+		best = std::min<int64_t>(best, d.d[s.y][s.x]);
+	}
+
+	return best;
+}
+
+static bool
+holds(term const &t, int64_t const (&v)[M_COUNT])
+{
+	switch (t.c) {
+	case CMP_EQ:
+		return v[t.m] == t.v;
+	case CMP_GE:
+		return v[t.m] >= t.v;
+	case CMP_GT:
+		return v[t.m] > t.v;
+	case CMP_LE:
+		return v[t.m] <= t.v;
+	case CMP_LT:
+		return v[t.m] < t.v;
+	case CMP_NE:
+		return v[t.m] != t.v;
+	}
+
+	return false;
+}
@@ -0,0 +1,21 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <cstdint>
+#include <string>
+
+#include "replay.h"
+
+/*
+ * Look for seeds whose first floor satisfies every term of an expression
+ * such as "rooms>=8,stair_dist>60,boss>=1", each a metric, a comparison
+ * and a number. Seeds from o.seed up are spread over all cores, building
+ * the floor, and spawning only if a term needs it, exactly as opal would
+ * with the same options. Stops once the lowest k matches are known,
+ * false if SEARCH_MAX seeds held fewer.
+ */
+uint64_t constexpr SEARCH_MAX = 1 << 24;
+
+bool	search_seeds(std::string const &, session_opts const &, uint64_t const);
+
+#endif /* SEARCH_H */
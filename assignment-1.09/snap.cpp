@@ -0,0 +1,491 @@
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "cerr.h"
+#include "gen.h"
+#include "npctab.h"
+#include "objtab.h"
+#include "replay.h"
+#include "rlg.h"
+#include "snap.h"
+#include "trace.h"
+#include "turn.h"
+
+struct snap_head {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	rng_size;
+	uint32_t	npc_size;
+	uint32_t	obj_size;
+	uint32_t	numnpcs;
+	uint32_t	numobjs;
+	uint32_t	style;
+	uint32_t	npc_descs;
+	uint32_t	obj_descs;
+	uint32_t	items;
+};
+
+static void	writer_main();
+static bool	write_file(std::vector<uint8_t> const &);
+static void	join_writer();
+static void	report_exit();
+static bool	read_order(uint8_t const *&, uint8_t const *const);
+static bool	read_file(uint8_t const *, std::size_t const, unsigned int &,
+	unsigned int &, floor_style &);
+static void	put(std::vector<uint8_t> &, void const *, std::size_t const);
+static bool	take(uint8_t const *&, uint8_t const *const, void *,
+	std::size_t const);
+
+static_assert(std::is_trivially_copyable_v<ranged_random>);
+
+static char const MAGIC[8] = { 'O', 'P', 'A', 'L', 'S', 'N', 'P', '1' };
+
+static char const *const FILEPATH = "/snapshot";
+static char const *const TMP_SUFFIX = ".tmp";
+
+/* as the session was started, for floors not made yet */
+static unsigned int numnpcs;
+static unsigned int numobjs;
+static floor_style style;
+
+/* filled by the engine, swapped with pending, so buffers are reused */
+static std::vector<uint8_t> capture;
+
+static std::mutex lock;
+static std::condition_variable wake;
+static std::vector<uint8_t> pending;
+static bool have_pending;
+static bool stopping;
+static std::thread writer;
+
+/* NPCs by index in the floor's order, as heaped, for snap_heap() */
+static std::vector<std::size_t> resume_order;
+static bool resumed;
+
+/* errno of a write that failed, reported by snap_stop() or on exit */
+static std::atomic<int> write_err;
+
+void
+snap_init(unsigned int const npcs, unsigned int const objs,
+	floor_style const s)
+{
+	numnpcs = npcs;
+	numobjs = objs;
+	style = s;
+
+	if (atexit(report_exit) != 0) {
+		cerrx(1, "snap atexit");
+	}
+}
+
+/*
+ * Called in the PC's turn, which resuming begins with, so the PC is off
+ * the heap. A recording's saves are skipped while it is replayed, or it
+ * would replace the player's own snapshot; the game plays on the same.
+ */
+void
+snap_quick(npc_heap const &heap)
+{
+	TRACE_SPAN("snap_quick");
+	ALLOC_PHASE(ALLOC_SAVE);
+
+	snap_head h = {};
+	obj_handle items[PC_ITEMS];
+
+	if (replaying()) {
+		return;
+	}
+
+	(void)std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = SNAP_VERSION;
+	h.rng_size = sizeof(ranged_random);
+	h.npc_size = sizeof(npc);
+	h.obj_size = sizeof(obj);
+	h.numnpcs = numnpcs;
+	h.numobjs = numobjs;
+	h.style = style;
+	h.npc_descs = (uint32_t)npcs_parsed.size();
+	h.obj_descs = (uint32_t)objs_parsed.size();
+	h.items = PC_ITEMS;
+
+	capture.clear();
+
+	put(capture, &h, sizeof(h));
+	put(capture, &rr, sizeof(rr));
+	put(capture, &player, sizeof(player));
+
+	/* rolled while parsing, and marked done as uniques spawn */
+	put(capture, npcs_parsed.data(), npcs_parsed.size() * sizeof(npc));
+	put(capture, objs_parsed.data(), objs_parsed.size() * sizeof(obj));
+
+	pc_items(items);
+
+	for (auto const i : items) {
+		capture.push_back(i != NO_OBJ);
+	}
+
+	for (auto const i : items) {
+		if (i != NO_OBJ) {
+			put(capture, &obj_get(i), sizeof(obj));
+		}
+	}
+
+	arrange_save(capture, npc_all());
+
+	uint32_t const heaped = (uint32_t)heap.size();
+
+	put(capture, &heaped, sizeof(heaped));
+
+	for (auto const id : heap) {
+		uint32_t const i = id - NPC_FIRST;
+
+		put(capture, &i, sizeof(i));
+	}
+
+	/* tunnelling may have changed the floor since they were found */
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			put(capture, &tiles[i][j].d, sizeof(tiles[i][j].d));
+			put(capture, &tiles[i][j].dt, sizeof(tiles[i][j].dt));
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> const l(lock);
+
+		std::swap(capture, pending);
+		have_pending = true;
+	}
+
+	wake.notify_one();
+
+	if (!writer.joinable()) {
+		writer = std::thread(writer_main);
+	}
+}
+
+/* wait for the last capture to be written */
+void
+snap_stop()
+{
+	join_writer();
+
+	/* taken, so the exit it makes doesn't report it again */
+	int const err = write_err.exchange(0);
+
+	if (err != 0) {
+		errno = err;
+		cerr(1, "quick-save");
+	}
+}
+
+/*
+ * Restore the game from the snapshot, with the counts and floor style it
+ * was started with, for floors not made yet. Descriptions must be parsed
+ * first. False if there is none, it doesn't fit this build, or it puts
+ * anything off the floor.
+ */
+bool
+snap_load(unsigned int &npcs, unsigned int &objs, floor_style &s)
+{
+	struct stat st;
+	int fd;
+	bool ret = false;
+	std::string const path = rlg_path() + FILEPATH;
+
+	if ((fd = open(path.c_str(), O_RDONLY)) == -1) {
+		cerr(1, "snapshot open");
+	}
+
+	if (fstat(fd, &st) == -1) {
+		cerr(1, "snapshot fstat");
+	}
+
+	if (st.st_size > 0) {
+		std::size_t const size = (std::size_t)st.st_size;
+		void *const m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (m == MAP_FAILED) {
+			cerr(1, "snapshot mmap");
+		}
+
+		ret = read_file(static_cast<uint8_t const *>(m), size, npcs,
+			objs, s);
+
+		if (munmap(m, size) == -1) {
+			cerr(1, "snapshot munmap");
+		}
+	}
+
+	if (close(fd) == -1) {
+		cerr(1, "snapshot close, (read_file=%d)", ret);
+	}
+
+	return ret;
+}
+
+/*
+ * True once after snap_load(), with the NPCs in the order they were heaped
+ * as indices into npc_all(), once cache_things() has filled it.
+ */
+bool
+snap_heap(std::vector<std::size_t> &order)
+{
+	if (!resumed) {
+		return false;
+	}
+
+	order = resume_order;
+	resumed = false;
+
+	return true;
+}
+
+static void
+writer_main()
+{
+	std::vector<uint8_t> buf;
+	std::unique_lock<std::mutex> l(lock);
+
+	for (;;) {
+		wake.wait(l, [] { return have_pending || stopping; });
+
+		if (!have_pending) {
+			return;
+		}
+
+		std::swap(buf, pending);
+		have_pending = false;
+
+		l.unlock();
+
+		if (!write_file(buf)) {
+			write_err = errno;
+		}
+
+		l.lock();
+	}
+}
+
+/* synced before it is renamed over the last, as save_dungeon() */
+static bool
+write_file(std::vector<uint8_t> const &buf)
+{
+	std::string const dir = rlg_path();
+	std::string const path = dir + FILEPATH;
+	std::string const tmp = path + TMP_SUFFIX;
+	int fd;
+
+	if (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST) {
+		return false;
+	}
+
+	if ((fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+		return false;
+	}
+
+	bool ok = write(fd, buf.data(), buf.size()) == (ssize_t)buf.size()
+		&& fsync(fd) == 0;
+
+	if (close(fd) == -1) {
+		ok = false;
+	}
+
+	if (!ok) {
+		int const err = errno;
+
+		(void)unlink(tmp.c_str());
+		errno = err;
+
+		return false;
+	}
+
+	return rename(tmp.c_str(), path.c_str()) == 0 && rlg_sync();
+}
+
+static void
+join_writer()
+{
+	{
+		std::lock_guard<std::mutex> const l(lock);
+
+		stopping = true;
+	}
+
+	wake.notify_one();
+
+	if (writer.joinable()) {
+		writer.join();
+	}
+}
+
+/*
+ * On any other exit(), cerr() and cerrx() included, as a std::thread still
+ * joinable when it is destroyed aborts the process. The last capture is
+ * written first, and a failure reported without exiting again.
+ */
+static void
+report_exit()
+{
+	join_writer();
+
+	int const err = write_err.exchange(0);
+
+	if (err != 0) {
+		(void)fprintf(stderr, "quick-save: %s\n", strerror(err));
+	}
+}
+
+static bool
+read_file(uint8_t const *p, std::size_t const size, unsigned int &npcs,
+	unsigned int &objs, floor_style &s)
+{
+	uint8_t const *const end = p + size;
+	snap_head h;
+	ranged_random r;
+	npc pc;
+	obj_handle items[PC_ITEMS];
+
+	if (!take(p, end, &h, sizeof(h))
+		|| std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0
+		|| h.version != SNAP_VERSION
+		|| h.rng_size != sizeof(ranged_random)
+		|| h.npc_size != sizeof(npc) || h.obj_size != sizeof(obj)
+		|| h.npc_descs != npcs_parsed.size()
+		|| h.obj_descs != objs_parsed.size()
+		|| h.items != PC_ITEMS || h.style > STYLE_CAVES) {
+		return false;
+	}
+
+	if (!take(p, end, &r, sizeof(r)) || !take(p, end, &pc, sizeof(pc))
+		|| !rlg_inside(pc.y, pc.x)) {
+		return false;
+	}
+
+	if (!take(p, end, npcs_parsed.data(), npcs_parsed.size() * sizeof(npc))
+		|| !take(p, end, objs_parsed.data(),
+		objs_parsed.size() * sizeof(obj))
+		|| (std::size_t)(end - p) < PC_ITEMS) {
+		return false;
+	}
+
+	/* the tables dice point at were the writer's */
+	for (auto &n : npcs_parsed) {
+		n.dam = dice_sampler(n.dam.base, n.dam.dice, n.dam.sides);
+	}
+
+	for (auto &o : objs_parsed) {
+		o.dam = dice_sampler(o.dam.base, o.dam.dice, o.dam.sides);
+	}
+
+	uint8_t const *const present = p;
+
+	p += PC_ITEMS;
+
+	for (std::size_t i = 0; i < PC_ITEMS; ++i) {
+		obj o;
+
+		items[i] = NO_OBJ;
+
+		if (!present[i]) {
+			continue;
+		}
+
+		if (!take(p, end, &o, sizeof(o))) {
+			return false;
+		}
+
+		o.dam = dice_sampler(o.dam.base, o.dam.dice, o.dam.sides);
+		items[i] = obj_new(o);
+	}
+
+	pc.dam = dice_sampler(pc.dam.base, pc.dam.dice, pc.dam.sides);
+
+	rr = r;
+	player = pc;
+
+	pc_items_set(items);
+
+	if (!arrange_restore(p, end) || !read_order(p, end) || p != end) {
+		return false;
+	}
+
+	npcs = h.numnpcs;
+	objs = h.numobjs;
+	s = (floor_style)h.style;
+
+	return true;
+}
+
+/* the turn order, then distances, both of the floor being played */
+static bool
+read_order(uint8_t const *&p, uint8_t const *const end)
+{
+	uint32_t heaped;
+
+	if (!take(p, end, &heaped, sizeof(heaped))
+		|| (std::size_t)(end - p) < heaped * sizeof(uint32_t)) {
+		return false;
+	}
+
+	resume_order.resize(heaped);
+
+	for (auto &i : resume_order) {
+		uint32_t v;
+
+		(void)take(p, end, &v, sizeof(v));
+		i = v;
+	}
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			if (!take(p, end, &tiles[i][j].d, sizeof(tiles[i][j].d))
+				|| !take(p, end, &tiles[i][j].dt,
+				sizeof(tiles[i][j].dt))) {
+				return false;
+			}
+		}
+	}
+
+	resumed = true;
+
+	return true;
+}
+
+static void
+put(std::vector<uint8_t> &out, void const *const src, std::size_t const n)
+{
+	uint8_t const *const b = static_cast<uint8_t const *>(src);
+
+	out.insert(out.end(), b, b + n);
+}
+
+static bool
+take(uint8_t const *&p, uint8_t const *const end, void *const dst,
+	std::size_t const n)
+{
+	if ((std::size_t)(end - p) < n) {
+		return false;
+	}
+
+	(void)std::memcpy(dst, p, n);
+	p += n;
+
+	return true;
+}
@@ -0,0 +1,34 @@
+#ifndef SNAP_H
+#define SNAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "floor.h"
+#include "globs.h"
+#include "turn.h"
+
+/*
+ * Whole-game snapshots in ~/.rlg327/snapshot: the generator, the PC and
+ * what it carries and wears, the descriptions as rolled when parsed, every
+ * floor with what is on it, see cache_save(), and the turn order and
+ * distances of the floor being played, so a resumed game goes on exactly
+ * as it would have. Blocks are the engine's own structs copied as they
+ * are behind a header of the version and their sizes, so a snapshot loads
+ * into a build that lays them out alike and has parsed the same
+ * descriptions.
+ *
+ * snap_quick() copies the game out on the engine thread and hands it to a
+ * writer thread, which replaces the file with a temporary and rename(). A
+ * capture not yet written is replaced by a newer one.
+ */
+uint32_t constexpr SNAP_VERSION = 1;
+
+void	snap_init(unsigned int const, unsigned int const, floor_style const);
+void	snap_quick(npc_heap const &);
+void	snap_stop();
+bool	snap_load(unsigned int &, unsigned int &, floor_style &);
+bool	snap_heap(std::vector<std::size_t> &);
+
+#endif /* SNAP_H */
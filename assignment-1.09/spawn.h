@@ -0,0 +1,77 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "globs.h"
+#include "stats.h"
+
+/*
+ * The rolls behind spawning, kept apart from the engine so a seed search
+ * can replay them on any thread: the generator, the floor, the PC's spot
+ * and what is already taken are all passed in.
+ */
+
+/* minimum distance from the PC a thing can be placed */
+double constexpr SPAWN_CUTOFF = 4.0;
+unsigned int constexpr SPAWN_RETRIES = 150;
+
+/* index of a template that passes its rarity roll, if found in time */
+template<typename T, typename D> std::optional<std::size_t>
+spawn_pick(std::vector<T> const &parsed, D const &done, ranged_random &rng)
+{
+	std::size_t i;
+	unsigned int retries = 0;
+
+	do {
+		i = rng.rrand<std::size_t>(0, parsed.size() - 1);
+		retries++;
+	} while (retries < SPAWN_RETRIES && (done(i)
+		|| parsed[i].rrty <= rng.rrand<uint8_t>(0, 99)));
+
+	stat_add(STAT_SPAWN_RETRIES, retries - 1);
+
+	if (retries == SPAWN_RETRIES) {
+		return {};
+	}
+
+	return i;
+}
+
+/* an open tile clear of the PC and of anything taken, if found in time */
+template<typename F> std::optional<std::pair<uint8_t, uint8_t>>
+spawn_spot(tile const (*const t)[WIDTH], uint8_t const pc_x,
+	uint8_t const pc_y, F const &taken, ranged_random &rng)
+{
+	uint8_t x, y;
+	std::size_t retries = 0;
+
+	auto const clear = [&](uint8_t const cy, uint8_t const cx) {
+		int const dx = cx - pc_x;
+		int const dy = cy - pc_y;
+
+		return t[cy][cx].h == 0
+			&& std::sqrt(dx * dx + dy * dy) > SPAWN_CUTOFF;
+	};
+
+	do {
+		x = rng.rrand<uint8_t>(1, WIDTH - 2);
+		y = rng.rrand<uint8_t>(1, HEIGHT - 2);
+		retries++;
+	} while (retries < SPAWN_RETRIES && (!clear(y, x) || taken(y, x)));
+
+	stat_add(STAT_SPAWN_RETRIES, retries - 1);
+
+	if (retries == SPAWN_RETRIES) {
+		return {};
+	}
+
+	return std::make_pair(x, y);
+}
+
+#endif /* SPAWN_H */
@@ -0,0 +1,299 @@
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#include <endian.h>
+#undef _BSD_SOURCE
+#undef _DEFAULT_SOURCE
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "cerr.h"
+#include "globs.h"
+#include "npctab.h"
+#include "statehash.h"
+
+static uint64_t	xxh64(uint8_t const *, std::size_t const, uint64_t const);
+static uint64_t	xxh_round(uint64_t, uint64_t const);
+static uint64_t	xxh_merge(uint64_t, uint64_t const);
+static uint64_t	read64(uint8_t const *const);
+static uint32_t	read32(uint8_t const *const);
+static uint64_t	rotl(uint64_t const, int const);
+
+static uint64_t constexpr P1 = 0x9E3779B185EBCA87ULL;
+static uint64_t constexpr P2 = 0xC2B2AE3D27D4EB4FULL;
+static uint64_t constexpr P3 = 0x165667B19E3779F9ULL;
+static uint64_t constexpr P4 = 0x85EBCA77C2B2AE63ULL;
+static uint64_t constexpr P5 = 0x27D4EB2F165667C5ULL;
+
+static char const MAGIC[8] = { 'O', 'P', 'A', 'L', 'H', 'S', 'H', '1' };
+
+static FILE *out;
+
+static std::vector<uint64_t> expect;
+static bool checking;
+
+/* turns hashed, and the first one that differed from expect */
+static uint64_t turns;
+static bool diverged;
+static bool ran_short;
+static uint64_t div_index;
+static uint64_t div_turn;
+
+/* state is packed here before hashing, reused between turns */
+static std::vector<uint8_t> buf;
+
+/* every tile, an NPC on each and the RNG, so turns never grow buf */
+static std::size_t constexpr BUF_MAX = HEIGHT * WIDTH
+	* (2 + 3 * sizeof(uint64_t)) + sizeof(uint64_t);
+
+uint64_t
+state_hash()
+{
+	buf.clear();
+
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			tile const &t = tiles[i][j];
+
+			buf.push_back(t.h);
+			buf.push_back((uint8_t)((t.n != NO_NPC ? 1 : 0)
+				| (t.o != NO_OBJ ? 2 : 0)));
+		}
+	}
+
+	/* scanning the tiles gives a fixed order for the NPCs */
+	for (int i = 0; i < HEIGHT; ++i) {
+		for (int j = 0; j < WIDTH; ++j) {
+			if (tiles[i][j].n == NO_NPC) {
+				continue;
+			}
+
+			npc const &n = npc_get(tiles[i][j].n);
+			uint64_t const v[3] = {
+				htole64((uint64_t)n.y << 8 | n.x),
+				htole64(n.hp),
+				htole64(n.turn)
+			};
+			uint8_t const *const p = (uint8_t const *)v;
+
+			buf.insert(buf.end(), p, p + sizeof(v));
+		}
+	}
+
+	uint64_t const rng = htole64(rr.fingerprint());
+	uint8_t const *const p = (uint8_t const *)&rng;
+
+	buf.insert(buf.end(), p, p + sizeof(rng));
+
+	return xxh64(buf.data(), buf.size(), 0);
+}
+
+void
+hash_write_open(std::string const &path)
+{
+	if ((out = fopen(path.c_str(), "wb")) == NULL) {
+		cerr(1, "hash fopen %s", path.c_str());
+	}
+
+	if (fwrite(MAGIC, sizeof(MAGIC), 1, out) != 1) {
+		cerr(1, "hash fwrite");
+	}
+
+	buf.reserve(BUF_MAX);
+}
+
+void
+hash_check_open(std::string const &path)
+{
+	FILE *f;
+	char magic[sizeof(MAGIC)];
+	uint64_t h;
+
+	if ((f = fopen(path.c_str(), "rb")) == NULL) {
+		cerr(1, "hash fopen %s", path.c_str());
+	}
+
+	if (fread(magic, sizeof(magic), 1, f) != 1
+		|| memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+		cerrx(1, "%s is not a hash stream", path.c_str());
+	}
+
+	while (fread(&h, sizeof(h), 1, f) == 1) {
+		expect.push_back(be64toh(h));
+	}
+
+	if (ferror(f)) {
+		cerr(1, "hash fread %s", path.c_str());
+	}
+
+	if (fclose(f) == EOF) {
+		cerr(1, "hash fclose");
+	}
+
+	checking = true;
+	buf.reserve(BUF_MAX);
+}
+
+/* called once every actor's turn, with the engine's turn counter */
+void
+hash_turn(uint64_t const turn)
+{
+	if (out == NULL && !checking) {
+		return;
+	}
+
+	uint64_t const h = state_hash();
+
+	if (out != NULL) {
+		uint64_t const be = htobe64(h);
+
+		if (fwrite(&be, sizeof(be), 1, out) != 1) {
+			cerr(1, "hash fwrite");
+		}
+	}
+
+	if (checking && !diverged
+		&& (turns >= expect.size() || expect[turns] != h)) {
+		diverged = true;
+		div_index = turns;
+		div_turn = turn;
+	}
+
+	turns++;
+}
+
+/* false if checking found a difference */
+bool
+hash_finish(std::ostream &os)
+{
+	if (out != NULL) {
+		if (fclose(out) == EOF) {
+			cerr(1, "hash fclose");
+		}
+
+		out = NULL;
+		os << "hash: " << turns << " turns written\n";
+	}
+
+	if (!checking) {
+		return true;
+	}
+
+	if (!diverged && turns < expect.size()) {
+		diverged = true;
+		ran_short = true;
+		div_index = turns;
+	}
+
+	if (ran_short) {
+		os << "hash: diverged at turn " << div_index << " (stream has "
+			<< expect.size() << " turns, run ended early)\n";
+	} else if (diverged) {
+		os << "hash: diverged at turn " << div_index << " (engine turn "
+			<< div_turn << ")\n";
+	} else {
+		os << "hash: " << turns << " turns match\n";
+	}
+
+	return !diverged;
+}
+
+/* XXH64, as specified by the xxHash reference */
+static uint64_t
+xxh64(uint8_t const *p, std::size_t const len, uint64_t const seed)
+{
+	uint8_t const *const end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		uint8_t const *const limit = end - 32;
+		uint64_t v1 = seed + P1 + P2;
+		uint64_t v2 = seed + P2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - P1;
+
+		do {
+			v1 = xxh_round(v1, read64(p));
+			v2 = xxh_round(v2, read64(p + 8));
+			v3 = xxh_round(v3, read64(p + 16));
+			v4 = xxh_round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = xxh_merge(h, v1);
+		h = xxh_merge(h, v2);
+		h = xxh_merge(h, v3);
+		h = xxh_merge(h, v4);
+	} else {
+		h = seed + P5;
+	}
+
+	h += len;
+
+	for (; p + 8 <= end; p += 8) {
+		h ^= xxh_round(0, read64(p));
+		h = rotl(h, 27) * P1 + P4;
+	}
+
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * P1;
+		h = rotl(h, 23) * P2 + P3;
+		p += 4;
+	}
+
+	for (; p < end; ++p) {
+		h ^= *p * P5;
+		h = rotl(h, 11) * P1;
+	}
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+static uint64_t
+xxh_round(uint64_t acc, uint64_t const input)
+{
+	acc += input * P2;
+	acc = rotl(acc, 31);
+	return acc * P1;
+}
+
+static uint64_t
+xxh_merge(uint64_t acc, uint64_t const val)
+{
+	acc ^= xxh_round(0, val);
+	return acc * P1 + P4;
+}
+
+static uint64_t
+read64(uint8_t const *const p)
+{
+	uint64_t v;
+
+	(void)memcpy(&v, p, sizeof(v));
+
+	return le64toh(v);
+}
+
+static uint32_t
+read32(uint8_t const *const p)
+{
+	uint32_t v;
+
+	(void)memcpy(&v, p, sizeof(v));
+
+	return le32toh(v);
+}
+
+static uint64_t
+rotl(uint64_t const x, int const r)
+{
+	return (x << r) | (x >> (64 - r));
+}
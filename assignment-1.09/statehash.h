@@ -0,0 +1,21 @@
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/*
+ * Per-turn fingerprint of the game state: tile hardness and occupancy,
+ * every NPC's position, HP and next turn, and the RNG state. Written as a
+ * stream by one build and checked by another on a replay of the same
+ * recording, it pins down the first turn at which their behaviour differs.
+ */
+uint64_t	state_hash();
+
+void	hash_write_open(std::string const &);
+void	hash_check_open(std::string const &);
+void	hash_turn(uint64_t const);
+bool	hash_finish(std::ostream &);
+
+#endif /* STATEHASH_H */
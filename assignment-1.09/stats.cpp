@@ -0,0 +1,96 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "stats.h"
+
+std::atomic<uint64_t> stat_counts[STAT_COUNT];
+
+static char const *const stat_names[STAT_COUNT] = {
+	"dijkstra calls",
+	"speculative fields",
+	"dijkstra nodes settled",
+	"dijkstra relaxations",
+	"los rays",
+	"los steps",
+	"npc turns erratic",
+	"npc turns line of sight",
+	"npc turns telepathic",
+	"npc turns dijkstra",
+	"npc turns tunnelling dijkstra",
+	"tunnel digs",
+	"spawn retries",
+	"room retries",
+	"cells drawn",
+	"floors restored",
+	"floors packed"
+};
+
+/* heap allocations through operator new, total and at each floor change */
+static std::atomic<uint64_t> allocs;
+static std::vector<uint64_t> floor_marks;
+
+void *
+operator new(std::size_t size)
+{
+	void *const p = std::malloc(size == 0 ? 1 : size);
+
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	allocs.fetch_add(1, std::memory_order_relaxed);
+
+	return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+/* later allocations count towards the next floor */
+void
+stats_next_floor()
+{
+	floor_marks.push_back(allocs.load(std::memory_order_relaxed));
+}
+
+void
+stats_print(std::ostream &os)
+{
+	char buf[64];
+	uint64_t prev = 0;
+
+	for (int i = 0; i < STAT_COUNT; ++i) {
+		(void)snprintf(buf, sizeof(buf), "%-30s %12" PRIu64 "\n",
+			stat_names[i],
+			stat_counts[i].load(std::memory_order_relaxed));
+		os << buf;
+	}
+
+	uint64_t const total = allocs.load(std::memory_order_relaxed);
+
+	for (std::size_t i = 0; i <= floor_marks.size(); ++i) {
+		uint64_t const mark = i < floor_marks.size()
+			? floor_marks[i] : total;
+
+		(void)snprintf(buf, sizeof(buf), "allocations floor %-12zu "
+			"%12" PRIu64 "\n", i + 1, mark - prev);
+		os << buf;
+		prev = mark;
+	}
+
+	(void)snprintf(buf, sizeof(buf), "%-30s %12" PRIu64 "\n",
+		"allocations", total);
+	os << buf;
+}
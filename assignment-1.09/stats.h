@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Engine-wide event counters, always kept and dumped with --stats. Adds are
+ * relaxed atomics; hot loops count locally and add once per call.
+ */
+enum stat_id {
+	STAT_DIJK_CALLS,
+	STAT_DIJK_SPEC,
+	STAT_DIJK_NODES,
+	STAT_DIJK_RELAX,
+	STAT_LOS_RAYS,
+	STAT_LOS_STEPS,
+	STAT_TURN_ERRATIC,
+	STAT_TURN_LOS,
+	STAT_TURN_TELE,
+	STAT_TURN_DIJK,
+	STAT_TURN_DIJK_TUNNEL,
+	STAT_TUNNEL_DIGS,
+	STAT_SPAWN_RETRIES,
+	STAT_ROOM_RETRIES,
+	STAT_CELLS_DRAWN,
+	STAT_FLOORS_RESTORED,
+	STAT_FLOORS_PACKED,
+	STAT_COUNT
+};
+
+extern std::atomic<uint64_t> stat_counts[STAT_COUNT];
+
+static inline void
+stat_add(stat_id const s, uint64_t const n = 1)
+{
+	stat_counts[s].fetch_add(n, std::memory_order_relaxed);
+}
+
+void	stats_next_floor();
+void	stats_print(std::ostream &);
+
+#endif /* STATS_H */
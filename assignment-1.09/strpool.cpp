@@ -0,0 +1,44 @@
+#include <deque>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+#include "cerr.h"
+#include "strpool.h"
+
+/*
+ * Names and descriptions are interned once while parsing and never change,
+ * so instances only carry ids. Elements of a deque are not moved by
+ * push_back, which keeps the views used as keys valid.
+ */
+static std::deque<std::string> pool(1);
+static std::unordered_map<std::string_view, str_id> ids;
+
+str_id
+str_intern(std::string const &s)
+{
+	if (s.empty()) {
+		return 0;
+	}
+
+	if (auto const it = ids.find(s); it != ids.end()) {
+		return it->second;
+	}
+
+	if (pool.size() >= std::numeric_limits<str_id>::max()) {
+		cerrx(1, "string pool full");
+	}
+
+	str_id const id = static_cast<str_id>(pool.size());
+
+	pool.push_back(s);
+	ids.emplace(pool.back(), id);
+
+	return id;
+}
+
+std::string const &
+str_get(str_id const id)
+{
+	return pool[id];
+}
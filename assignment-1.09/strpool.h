@@ -0,0 +1,13 @@
+#ifndef STRPOOL_H
+#define STRPOOL_H
+
+#include <cstdint>
+#include <string>
+
+/* id of an interned string, 0 is the empty string */
+typedef uint32_t str_id;
+
+str_id			str_intern(std::string const &);
+std::string const	&str_get(str_id const);
+
+#endif /* STRPOOL_H */
@@ -0,0 +1,127 @@
+#ifdef OPAL_TRACE
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "cerr.h"
+#include "trace.h"
+
+struct trace_event {
+	char const	*name;
+	uint64_t	start;
+	uint64_t	dur;
+};
+
+/* one per thread, appended to without locking */
+struct trace_buf {
+	std::vector<trace_event>	ev;
+	unsigned int			tid;
+};
+
+static uint64_t		now_ns();
+static trace_buf	&local_buf();
+
+/* initial events per buffer; a turn records a few dozen */
+static std::size_t constexpr TRACE_CHUNK = 1 << 12;
+
+static std::chrono::steady_clock::time_point const epoch =
+	std::chrono::steady_clock::now();
+
+/*
+ * Buffers outlive their threads, so short-lived workers keep their spans,
+ * and are reused by later threads rather than piling up.
+ */
+static std::mutex bufs_mtx;
+static std::vector<trace_buf *> bufs;
+static std::vector<trace_buf *> idle;
+
+trace_span::trace_span(char const *const n)
+	: name(n), start(now_ns())
+{
+}
+
+trace_span::~trace_span()
+{
+	local_buf().ev.push_back({ name, start, now_ns() - start });
+}
+
+/* all threads that recorded spans must be joined or idle by now */
+void
+trace_write(char const *const path)
+{
+	FILE *f;
+	bool first = true;
+
+	std::lock_guard<std::mutex> const lock(bufs_mtx);
+
+	if ((f = fopen(path, "w")) == NULL) {
+		cerr(1, "trace fopen %s", path);
+	}
+
+	(void)fputs("{\"traceEvents\":[\n", f);
+
+	for (auto const *b : bufs) {
+		for (auto const &e : b->ev) {
+			(void)fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\","
+				"\"pid\":1,\"tid\":%u,\"ts\":%" PRIu64 ".%03"
+				PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 "}",
+				first ? "" : ",\n", e.name, b->tid,
+				e.start / 1000, e.start % 1000,
+				e.dur / 1000, e.dur % 1000);
+			first = false;
+		}
+	}
+
+	(void)fputs("\n],\"displayTimeUnit\":\"ns\"}\n", f);
+
+	if (fclose(f) == EOF) {
+		cerr(1, "trace fclose %s", path);
+	}
+}
+
+static uint64_t
+now_ns()
+{
+	return static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - epoch).count());
+}
+
+static trace_buf &
+local_buf()
+{
+	/* hands the buffer back on thread exit, for the next worker */
+	thread_local struct holder {
+		trace_buf	*b = nullptr;
+
+		~holder()
+		{
+			std::lock_guard<std::mutex> const lock(bufs_mtx);
+
+			if (b != nullptr) {
+				idle.push_back(b);
+			}
+		}
+	} h;
+
+	if (h.b == nullptr) {
+		std::lock_guard<std::mutex> const lock(bufs_mtx);
+
+		if (!idle.empty()) {
+			h.b = idle.back();
+			idle.pop_back();
+		} else {
+			h.b = new trace_buf;
+			h.b->ev.reserve(TRACE_CHUNK);
+			h.b->tid = static_cast<unsigned int>(bufs.size()) + 1;
+			bufs.push_back(h.b);
+		}
+	}
+
+	return *h.b;
+}
+
+#endif /* OPAL_TRACE */
@@ -0,0 +1,42 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Scoped-timer spans, compiled in only with -DOPAL_TRACE (make trace). A
+ * span records its name, thread, start and duration when it goes out of
+ * scope; trace_write() dumps them all as Chrome trace-event JSON. Without
+ * the flag TRACE_SPAN expands to nothing.
+ */
+#ifdef OPAL_TRACE
+
+#include <cstdint>
+
+class trace_span {
+	char const	*name;
+	uint64_t	start;
+public:
+	explicit trace_span(char const *const);
+	~trace_span();
+
+	trace_span(trace_span const &) = delete;
+	trace_span	&operator=(trace_span const &) = delete;
+};
+
+#define TRACE_CAT2(a, b)	a##b
+#define TRACE_CAT(a, b)		TRACE_CAT2(a, b)
+#define TRACE_SPAN(name)	trace_span const TRACE_CAT(trace_, __LINE__)(name)
+
+void	trace_write(char const *const);
+
+#else
+
+#define TRACE_SPAN(name)
+
+static inline void
+trace_write(char const *const)
+{
+}
+
+#endif /* OPAL_TRACE */
+
+#endif /* TRACE_H */
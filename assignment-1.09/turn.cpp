@@ -2,73 +2,94 @@
 #include <cinttypes>
 #include <functional>
 #include <limits>
-#include <new>
-#include <queue>
+#include <optional>
 #include <sstream>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include <ncurses.h>
+
+#include "alloc.h"
+#include "cache.h"
 #include "cerr.h"
 #include "dijk.h"
+#include "gen.h"
 #include "globs.h"
+#include "npctab.h"
+#include "objtab.h"
+#include "render.h"
+#include "ring.h"
+#include "snap.h"
+#include "spawn.h"
+#include "statehash.h"
+#include "stats.h"
+#include "trace.h"
 #include "turn.h"
 
-static bool	valid_thing(uint8_t const, uint8_t const);
-
 static double		distance(uint8_t const, uint8_t const, uint8_t const, uint8_t const);
 static unsigned int	subu32(unsigned int const, unsigned int const);
 static uint64_t		subu64(uint64_t const, uint64_t const);
 
 static bool	pc_visible(int const, int const);
 
-static void	npc_obj_or_tile(WINDOW *const, uint8_t const, uint8_t const);
+static void	npc_obj_or_tile(fb_layer const, uint8_t const, uint8_t const);
 
 static uint64_t	effective_dam();
 static uint64_t	combat(npc &, npc &);
 
-static void	move_redraw(WINDOW *const, npc &, uint8_t const, uint8_t const);
-static void	move_logic(WINDOW *const, npc &, uint8_t const, uint8_t const);
-static void	move_tunnel(WINDOW *const, npc &, uint8_t const, uint8_t const);
+static void	move_redraw(npc &, uint8_t const, uint8_t const);
+static void	move_logic(npc &, uint8_t const, uint8_t const);
+static void	move_tunnel(npc &, uint8_t const, uint8_t const);
+
+static void	move_straight(npc &);
+static void	move_dijk_nontunneling(npc &);
+static void	move_dijk_tunneling(npc &);
+
+static void		spawn_npcs(unsigned int const);
+static void		spawn_objs(unsigned int const);
 
-static void	move_straight(WINDOW *const, npc &);
-static void	move_dijk_nontunneling(WINDOW *const, npc &);
-static void	move_dijk_tunneling(WINDOW *const, npc &);
+template<typename T> static std::optional<std::size_t>
+	pick_template(std::vector<T> const &);
 
-static std::optional<std::pair<uint8_t, uint8_t>>	gen_npc();
-static std::optional<std::pair<uint8_t, uint8_t>>	gen_obj();
+static void	heap_push(npc_heap &, npc_id const);
+static npc_id	heap_pop(npc_heap &);
 
-static void	npc_list(WINDOW *const, std::vector<npc *> const &);
+static void	npc_list(std::vector<npc> const &);
 
-static void	defog(WINDOW *const);
+static void	defog();
+static void	redraw_seen();
 
-static void	crosshair(WINDOW *const, uint8_t const, uint8_t const);
-static bool	inspect(WINDOW *const, bool const);
+static void	crosshair(uint8_t const, uint8_t const);
+static bool	inspect(bool const);
 
 static bool	viewable(int const, int const);
-static void	pc_viewbox(WINDOW *const, int const);
 
 static void	try_carry(uint8_t const, uint8_t const);
 
-static void	equip_list(WINDOW *const, bool const);
+static void	equip_list(bool const);
 
+static void	equip_update();
 static void	carry_to_equip(int const);
 static void	equip_to_carry(int const, std::optional<std::string> &);
 
-static void	thing_details(WINDOW *const, dungeon_thing const &);
+static void	thing_details(dungeon_thing const &);
 
 enum pc_action {
 	PC_DEFOG,
-	PC_NEXT,
+	PC_DOWN,
 	PC_NONE,
 	PC_NPC_LIST,
 	PC_QUIT,
 	PC_RETRY,
-	PC_TELE
+	PC_SAVE,
+	PC_TELE,
+	PC_UNDO,
+	PC_UP
 };
 
-static enum pc_action	turn_npc(WINDOW *const, WINDOW *const, npc &);
-static enum pc_action	turn_pc(WINDOW *const, WINDOW *const, npc &);
+static enum pc_action	turn_npc(npc &);
+static enum pc_action	turn_pc(npc &);
 
 enum carry_action {
 	CARRY_DROP,
@@ -78,21 +99,50 @@ enum carry_action {
 	CARRY_WEAR
 };
 
-static void	carry_list(WINDOW *const, carry_action const);
+static void	carry_list(carry_action const);
+
+static int constexpr EQUIP_SLOTS = 12;
+
+/* derived from the equipped items, see equip_update() */
+struct equip_stats {
+	dice_sampler	dam[EQUIP_SLOTS];
+	int		dam_count;
+	uint64_t	def;
+	uint64_t	dodge;
+	uint64_t	hit;
+	uint64_t	speed;
+};
 
 struct equip {
-	std::optional<obj>	amulet;
-	std::optional<obj>	armor;
-	std::optional<obj>	boots;
-	std::optional<obj>	cloak;
-	std::optional<obj>	gloves;
-	std::optional<obj>	helmet;
-	std::optional<obj>	light;
-	std::optional<obj>	offhand;
-	std::optional<obj>	ranged;
-	std::optional<obj>	ring_left;
-	std::optional<obj>	ring_right;
-	std::optional<obj>	weapon;
+	obj_handle	amulet;
+	obj_handle	armor;
+	obj_handle	boots;
+	obj_handle	cloak;
+	obj_handle	gloves;
+	obj_handle	helmet;
+	obj_handle	light;
+	obj_handle	offhand;
+	obj_handle	ranged;
+	obj_handle	ring_left;
+	obj_handle	ring_right;
+	obj_handle	weapon;
+
+	equip_stats	stats;
+};
+
+static obj_handle equip::*const equip_slots[EQUIP_SLOTS] = {
+	&equip::amulet,
+	&equip::armor,
+	&equip::boots,
+	&equip::cloak,
+	&equip::gloves,
+	&equip::helmet,
+	&equip::light,
+	&equip::offhand,
+	&equip::ranged,
+	&equip::ring_left,
+	&equip::ring_right,
+	&equip::weapon
 };
 
 static char const *const type_map_name[] = {
@@ -140,157 +190,77 @@ static bool type_map_equip[] = {
 };
 
 struct compare_npc {
-	bool constexpr
-	operator() (npc const &x, npc const &y) const
+	bool
+	operator() (npc_id const x, npc_id const y) const
 	{
-		return x.turn > y.turn;
+		return npc_get(x).turn > npc_get(y).turn;
 	}
 };
 
-/* minimum distance from the PC an NPC can be placed */
-static double constexpr CUTOFF = 4.0;
 static int constexpr PERSISTANCE = 5;
 static int constexpr KEY_ESC = 27;
 static int constexpr DEFAULT_LUMINANCE = 5;
-static unsigned int constexpr RETRIES = 150;
 static int constexpr PC_CARRY_MAX = 10;
 
-static std::optional<obj> pc_carry[PC_CARRY_MAX];
+static obj_handle pc_carry[PC_CARRY_MAX];
 static equip pc_equip;
 
+static_assert(PC_ITEMS == PC_CARRY_MAX + EQUIP_SLOTS);
+
 enum turn_exit
-turn_engine(WINDOW *const win, unsigned int const numnpcs,
-	unsigned int const numobjs)
+turn_engine(unsigned int const numnpcs, unsigned int const numobjs)
 {
-	std::priority_queue<npc, std::vector<std::reference_wrapper<npc>>, compare_npc> heap;
-	std::vector<npc *> npcs;
-	std::vector<obj *> objs;
-	unsigned int real_num = 0;
-
-	WINDOW *sep;
+	npc_heap heap;
+	std::vector<std::size_t> order;
+	bool pc_first = false;
 
 	uint64_t turn;
 	enum turn_exit ret = TURN_NONE;
 
-	try {
-		npcs.resize(numnpcs);
-		objs.resize(numobjs);
-	} catch (std::bad_alloc const &) {
-		cerr(1, "resize npcs and objs");
-	}
-
-	tiles[player.y][player.x].n = &player;
-
-	wattron(win, player.color);
-	(void)mvwaddch(win, player.y, player.x, player.symb);
-	wattroff(win, player.color);
-
-	heap.push(player);
+	tiles[player.y][player.x].n = PC_ID;
 
-	for (auto &n : npcs) {
-		size_t i;
-		unsigned int retries = 0;
-		do {
-			i = rr.rrand<size_t>(0, npcs_parsed.size() - 1);
-			retries++;
-		} while (retries < RETRIES && (npcs_parsed[i].done
-			|| npcs_parsed[i].rrty <= rr.rrand<uint8_t>(0, 99)));
-
-		if (retries == RETRIES) {
-			break;
-		}
-
-		std::optional<std::pair<uint8_t, uint8_t>> coords = gen_npc();
-
-		if (!coords.has_value()) {
-			break;
-		}
-
-		real_num++;
-
-		n = new npc(npcs_parsed[i]);
-
-		if (n->type & UNIQ) {
-			n->done = true;
-			npcs_parsed[i].done = true;
-		}
+	ring_clear();
 
-		n->x = coords->first;
-		n->y = coords->second;
+	fb_put(FB_VIEW, player.y, player.x, player.symb, player.color);
 
-		tiles[n->y][n->x].n = n;
+	if (cache_things()) {
+		redraw_seen();
 
-		heap.push(*n);
-	}
-
-	if (real_num != numnpcs) {
-		npcs.resize(real_num);
+		pc_first = snap_heap(order);
+	} else {
+		spawn_npcs(numnpcs);
+		spawn_objs(numobjs);
 	}
 
-	real_num = 0;
+	std::vector<npc> const &npcs = npc_all();
 
-	for (auto &o : objs) {
-		size_t i = 0;
-		unsigned int retries = 0;
-		do {
-			i = rr.rrand<size_t>(0, objs_parsed.size() - 1);
-			retries++;
-		} while (retries < RETRIES && (objs_parsed[i].done
-			|| objs_parsed[i].rrty <= rr.rrand<uint8_t>(0, 99)));
+	if (pc_first) {
+		/* resumed in the PC's turn, the rest heaped as they were */
+		for (auto const i : order) {
+			if (i >= npcs.size()) {
+				cerrx(1, "snapshot turn order invalid");
+			}
 
-		if (retries == RETRIES) {
-			break;
+			heap_push(heap, static_cast<npc_id>(i + NPC_FIRST));
 		}
+	} else {
+		heap_push(heap, PC_ID);
 
-		std::optional<std::pair<uint8_t, uint8_t>> coords = gen_obj();
-
-		if (!coords.has_value()) {
-			break;
+		for (std::size_t i = 0; i < npcs.size(); ++i) {
+			heap_push(heap, static_cast<npc_id>(i + NPC_FIRST));
 		}
-
-		real_num++;
-
-		o = new obj(objs_parsed[i]);
-
-		if (o->art) {
-			o->done = true;
-			objs_parsed[i].done = true;
-		}
-
-		o->x = coords->first;
-		o->y = coords->second;
-
-		tiles[o->y][o->x].o = o;
-	}
-
-	if (real_num != numobjs) {
-		objs.resize(real_num);
-	}
-
-	dijkstra();
-
-	if ((sep = newwin(HEIGHT, WIDTH, 0, 0)) == NULL) {
-		cerrx(1, "newwin sep");
-	}
-
-	if (keypad(sep, true) == ERR) {
-		cerrx(1, "keypad sep");
 	}
 
-	(void)box(sep, 0, 0);
+	/* distances come with the floor, see arrange_renew() */
+	pc_viewbox(DEFAULT_LUMINANCE);
 
-	pc_viewbox(win, DEFAULT_LUMINANCE);
+	fb_print(FB_VIEW, HEIGHT - 1, 2, 0, "[ hp: %" PRIu64 " ]", player.hp);
 
-	(void)mvwprintw(win, HEIGHT - 1, 2,
-		"[ hp: %" PRIu64 " ]", player.hp);
+	while (pc_first || !heap.empty()) {
+		npc_id const id = pc_first ? PC_ID : heap_pop(heap);
+		npc &n = npc_get(id);
 
-	while (!heap.empty()) {
-		npc &n = heap.top();
-		heap.pop();
-
-		if (n.type & PLAYER_TYPE && wrefresh(win) == ERR) {
-			cerrx(1, "turn_engine wrefresh");
-		}
+		pc_first = false;
 
 		if (n.hp == 0) {
 			if (n.type & PLAYER_TYPE) {
@@ -304,67 +274,98 @@ turn_engine(WINDOW *const win, unsigned int const numnpcs,
 			}
 		}
 
+		if (n.type & PLAYER_TYPE) {
+			ring_turn(heap);
+		}
+
 		turn = n.turn + 1;
 		n.turn = turn + 1000/n.speed;
 
-		retry:
-		if (touchwin(win) == ERR) {
-			cerrx(1, "touchwin");
+		if (n.type & PLAYER_TYPE) {
+			alloc_pc_turn();
 		}
 
-		switch(turn_npc(win, sep, n)) {
+		retry:
+		fb_clear(FB_MENU);
+
+		switch(turn_npc(n)) {
 		case PC_DEFOG:
-			defog(sep);
+			defog();
 			goto retry;
-		case PC_NEXT:
-			ret = TURN_NEXT;
+		case PC_DOWN:
+			ret = TURN_DOWN;
 			goto exit;
 		case PC_NONE:
 			break;
 		case PC_NPC_LIST:
-			npc_list(sep, npcs);
+			npc_list(npcs);
 			goto retry;
 		case PC_QUIT:
 			ret = TURN_QUIT;
 			goto exit;
 		case PC_RETRY:
 			goto retry;
+		case PC_SAVE:
+			/* as the turn began, so a resumed game gives the PC the move */
+			n.turn = turn - 1;
+			snap_quick(heap);
+			n.turn = turn + 1000/n.speed;
+			goto retry;
+		case PC_UNDO:
+			/* the speculative search reads the tiles */
+			spec_cancel();
+
+			if (!ring_undo(heap)) {
+				goto retry;
+			}
+
+			fb_erase(FB_VIEW);
+			fb_box(FB_VIEW, 0);
+			redraw_seen();
+			fb_print(FB_VIEW, HEIGHT - 1, 2, 0, "[ hp: %" PRIu64 " ]",
+				player.hp);
+
+			/* the PC, off the heap when captured, moves first */
+			pc_first = true;
+			continue;
 		case PC_TELE:
-			if (inspect(win, true)) {
+			if (inspect(true)) {
+				dijkstra();
 				break;
 			} else {
 				goto retry;
 			}
+		case PC_UP:
+			ret = TURN_UP;
+			goto exit;
 		}
 
-		heap.push(n);
+		hash_turn(turn);
+
+		heap_push(heap, id);
 	}
 
 	exit:
 
-	for (auto &n : npcs) {
-		delete n;
-	}
+	spec_cancel();
 
-	for (auto &o : objs) {
-		delete o;
+	if (ret == TURN_DOWN || ret == TURN_UP) {
+		arrange_leave(npcs);
 	}
 
-	if (delwin(sep) == ERR) {
-		cerrx(1, "turn_engine delwin sep");
-	}
-
-	return ret;
-}
+	npc_clear();
 
-static bool
-valid_thing(uint8_t const y, uint8_t const x)
-{
-	if (tiles[y][x].h != 0) {
-		return false;
+	/* anything carried or worn stays, the rest goes with the floor */
+	for (std::size_t i = 0; i < HEIGHT; ++i) {
+		for (std::size_t j = 0; j < WIDTH; ++j) {
+			if (tiles[i][j].o != NO_OBJ) {
+				obj_free(tiles[i][j].o);
+				tiles[i][j].o = NO_OBJ;
+			}
+		}
 	}
 
-	return distance(player.x, player.y, x, y) > CUTOFF;
+	return ret;
 }
 
 static double
@@ -408,16 +409,21 @@ pc_visible(int const x1, int const y1)
 	int const sy = y0 < y1 ? 1 : -1;
 
 	int err = (dx > dy ? dx : -dy) / 2;
+	uint64_t steps = 0;
+	bool seen = true;
 
 	while (1) {
 		if (tiles[y0][x0].h != 0) {
-			return false;
+			seen = false;
+			break;
 		}
 
 		if (x0 == x1 && y0 == y1) {
 			break;
 		}
 
+		steps++;
+
 		int e2 = err;
 
 		if (e2 > -dx) {
@@ -431,52 +437,34 @@ pc_visible(int const x1, int const y1)
 		}
 	}
 
-	return true;
+	stat_add(STAT_LOS_RAYS);
+	stat_add(STAT_LOS_STEPS, steps);
+
+	return seen;
 }
 
 static void
-npc_obj_or_tile(WINDOW *const win, uint8_t const y, uint8_t const x)
+npc_obj_or_tile(fb_layer const l, uint8_t const y, uint8_t const x)
 {
-	if (tiles[y][x].n != NULL) {
-		wattron(win, tiles[y][x].n->color);
-		(void)mvwaddch(win, y, x, tiles[y][x].n->symb);
-		wattroff(win, tiles[y][x].n->color);
-	} else if (tiles[y][x].o != NULL) {
-		wattron(win, tiles[y][x].o->color);
-		(void)mvwaddch(win, y, x, tiles[y][x].o->symb);
-		wattroff(win, tiles[y][x].o->color);
+	if (tiles[y][x].n != NO_NPC) {
+		npc const &n = npc_get(tiles[y][x].n);
+
+		fb_put(l, y, x, n.symb, n.color);
+	} else if (tiles[y][x].o != NO_OBJ) {
+		obj const &o = obj_get(tiles[y][x].o);
+		fb_put(l, y, x, o.symb, o.color);
 	} else {
-		(void)mvwaddch(win, y, x, tiles[y][x].c);
+		fb_put(l, y, x, tiles[y][x].c, 0);
 	}
 }
 
 static uint64_t
 effective_dam()
 {
-	int const length = 12;
-	std::optional<obj> const equip[] = {
-		pc_equip.amulet,
-		pc_equip.armor,
-		pc_equip.boots,
-		pc_equip.cloak,
-		pc_equip.gloves,
-		pc_equip.helmet,
-		pc_equip.light,
-		pc_equip.offhand,
-		pc_equip.ranged,
-		pc_equip.ring_left,
-		pc_equip.ring_right,
-		pc_equip.weapon
-	};
+	uint64_t dam = rr.roll(player.dam);
 
-	uint64_t dam = rr.rand_dice<uint64_t>(player.dam.base, player.dam.dice,
-		player.dam.sides);
-
-	for (int i = 0; i < length; ++i) {
-		if (equip[i].has_value()) {
-			dam += rr.rand_dice<uint64_t>(equip[i]->dam.base,
-				equip[i]->dam.dice, equip[i]->dam.sides);
-		}
+	for (int i = 0; i < pc_equip.stats.dam_count; ++i) {
+		dam += rr.roll(pc_equip.stats.dam[i]);
 	}
 
 	return dam;
@@ -485,8 +473,7 @@ effective_dam()
 static uint64_t
 combat(npc &n1, npc &n2)
 {
-	uint64_t n1_dam = rr.rand_dice<uint64_t>(n1.dam.base, n1.dam.dice,
-		n1.dam.sides);
+	uint64_t n1_dam = rr.roll(n1.dam);
 	uint64_t n2_hp = n2.hp;
 
 	if (n1.type & PLAYER_TYPE) {
@@ -501,19 +488,17 @@ combat(npc &n1, npc &n2)
 }
 
 static void
-move_redraw(WINDOW *const win, npc &n, uint8_t const y, uint8_t const x)
+move_redraw(npc &n, uint8_t const y, uint8_t const x)
 {
-	tiles[n.y][n.x].n = NULL;
-	tiles[y][x].n = &n;
+	tiles[n.y][n.x].n = NO_NPC;
+	tiles[y][x].n = npc_id_of(n);
 
 	if (tiles[n.y][n.x].v || n.type & PLAYER_TYPE) {
-		npc_obj_or_tile(win, n.y, n.x);
+		npc_obj_or_tile(FB_VIEW, n.y, n.x);
 	}
 
 	if (tiles[y][x].v) {
-		wattron(win, n.color);
-		(void)mvwaddch(win, y, x, n.symb);
-		wattroff(win, n.color);
+		fb_put(FB_VIEW, y, x, n.symb, n.color);
 	}
 
 	n.y = y;
@@ -521,38 +506,42 @@ move_redraw(WINDOW *const win, npc &n, uint8_t const y, uint8_t const x)
 }
 
 static void
-move_logic(WINDOW *const win, npc &n, uint8_t const y, uint8_t const x)
+move_logic(npc &n, uint8_t const y, uint8_t const x)
 {
+	TRACE_SPAN("move_logic");
+
 	if (n.y == y && n.x == x) {
 		return;
 	}
 
 	/* move to empty tile */
-	if (tiles[y][x].n == NULL) {
-		move_redraw(win, n, y, x);
+	if (tiles[y][x].n == NO_NPC) {
+		move_redraw(n, y, x);
 		return;
 	}
 
+	npc &other = npc_get(tiles[y][x].n);
+
 	/* npc-pc combat */
-	if (n.type & PLAYER_TYPE || tiles[y][x].n->type & PLAYER_TYPE) {
-		uint64_t dam = combat(n, *tiles[y][x].n);
+	if (n.type & PLAYER_TYPE || other.type & PLAYER_TYPE) {
+		uint64_t dam = combat(n, other);
 
-		(void)box(win, 0, 0);
-		(void)mvwprintw(win, HEIGHT - 1, 2,
+		fb_box(FB_VIEW, 0);
+		fb_print(FB_VIEW, HEIGHT - 1, 2, 0,
 			"[ hp: %" PRIu64 " ]", player.hp);
 
 		if (n.type & PLAYER_TYPE) {
-			(void)mvwprintw(win, HEIGHT - 1, WIDTH / 4,
+			fb_print(FB_VIEW, HEIGHT - 1, WIDTH / 4, 0,
 				"[ delt %" PRIu64 " damage ]", dam);
 		} else {
-			(void)mvwprintw(win, HEIGHT - 1, WIDTH / 4,
+			fb_print(FB_VIEW, HEIGHT - 1, WIDTH / 4, 0,
 				"[ received %" PRIu64 " damage ]", dam);
 		}
 
-		if (tiles[y][x].n->hp == 0) {
-			tiles[y][x].n->dead = true;
-			tiles[y][x].n = NULL;
-			npc_obj_or_tile(win, y, x);
+		if (other.hp == 0) {
+			other.dead = true;
+			tiles[y][x].n = NO_NPC;
+			npc_obj_or_tile(FB_VIEW, y, x);
 		}
 
 		return;
@@ -561,36 +550,37 @@ move_logic(WINDOW *const win, npc &n, uint8_t const y, uint8_t const x)
 	/* npc-to-npc */
 	for (int i = -1; i <= 1; ++i) {
 		for (int j = -1; j <= 1; ++j) {
-			uint8_t tx = (uint8_t)(tiles[y][x].n->x + i);
-			uint8_t ty = (uint8_t)(tiles[y][x].n->y + j);
+			uint8_t tx = (uint8_t)(other.x + i);
+			uint8_t ty = (uint8_t)(other.y + j);
 
 			if (tx == 0 || ty == 0 || tx >= WIDTH - 1
 				|| ty >= HEIGHT - 1) {
 				continue;
 			}
 
-			if (tiles[ty][tx].n == NULL && tiles[ty][tx].h == 0) {
-				/* move to tiles[y][x].n to ty, tx */
-				move_redraw(win, *tiles[y][x].n, ty, tx);
-				move_redraw(win, n, y, x);
+			if (tiles[ty][tx].n == NO_NPC && tiles[ty][tx].h == 0) {
+				/* move other to ty, tx */
+				move_redraw(other, ty, tx);
+				move_redraw(n, y, x);
 				return;
 			}
 		}
 	}
 
-	/* swap tiles[y][x].n with n */
-	move_redraw(win, *tiles[y][x].n, n.y, n.x);
-	move_redraw(win, n, y, x);
+	/* swap other with n */
+	move_redraw(other, n.y, n.x);
+	move_redraw(n, y, x);
 }
 
 static void
-move_tunnel(WINDOW *const win, npc &n, uint8_t const y, uint8_t const x)
+move_tunnel(npc &n, uint8_t const y, uint8_t const x)
 {
 	if (tiles[y][x].h == UINT8_MAX) {
 		return;
 	}
 
 	tiles[y][x].h = (uint8_t)subu32(tiles[y][x].h, TUNNEL_STRENGTH);
+	stat_add(STAT_TUNNEL_DIGS);
 
 	dijkstra();
 
@@ -602,11 +592,11 @@ move_tunnel(WINDOW *const win, npc &n, uint8_t const y, uint8_t const x)
 		tiles[y][x].c = CORRIDOR;
 	}
 
-	move_logic(win, n, y, x);
+	move_logic(n, y, x);
 }
 
 static void
-move_straight(WINDOW *const win, npc &n)
+move_straight(npc &n)
 {
 	double min = std::numeric_limits<double>::max();
 	uint8_t minx = n.x;
@@ -632,14 +622,14 @@ move_straight(WINDOW *const win, npc &n)
 	}
 
 	if (n.type & TUNNEL) {
-		move_tunnel(win, n, miny, minx);
+		move_tunnel(n, miny, minx);
 	} else {
-		move_logic(win, n, miny, minx);
+		move_logic(n, miny, minx);
 	}
 }
 
 static void
-move_dijk_nontunneling(WINDOW *const win, npc &n)
+move_dijk_nontunneling(npc &n)
 {
 	int32_t min_d = tiles[n.y][n.x].d;
 	uint8_t minx = n.x;
@@ -663,11 +653,11 @@ move_dijk_nontunneling(WINDOW *const win, npc &n)
 		}
 	}
 
-	move_logic(win, n, miny, minx);
+	move_logic(n, miny, minx);
 }
 
 static void
-move_dijk_tunneling(WINDOW *const win, npc &n)
+move_dijk_tunneling(npc &n)
 {
 	int32_t min_dt = tiles[n.y][n.x].dt;
 	uint8_t minx = n.x;
@@ -686,57 +676,149 @@ move_dijk_tunneling(WINDOW *const win, npc &n)
 		}
 	}
 
-	move_tunnel(win, n, miny, minx);
+	move_tunnel(n, miny, minx);
 }
 
-static std::optional<std::pair<uint8_t, uint8_t>>
-gen_npc()
+/* as std::priority_queue does, so the order is the same */
+static void
+heap_push(npc_heap &heap, npc_id const id)
 {
-	uint8_t x, y;
-	size_t retries = 0;
+	heap.push_back(id);
+	std::push_heap(heap.begin(), heap.end(), compare_npc());
+}
 
-	do {
-		x = rr.rrand<uint8_t>(1, WIDTH - 2);
-		y = rr.rrand<uint8_t>(1, HEIGHT - 2);
-		retries++;
-	} while (retries < RETRIES && (!valid_thing(y, x)
-		|| tiles[y][x].n != NULL));
-
-	if (retries == RETRIES) {
-		return {};
-	}
+static npc_id
+heap_pop(npc_heap &heap)
+{
+	std::pop_heap(heap.begin(), heap.end(), compare_npc());
 
-	return std::make_pair(x, y);
+	npc_id const id = heap.back();
+
+	heap.pop_back();
+
+	return id;
 }
 
-static std::optional<std::pair<uint8_t, uint8_t>>
-gen_obj()
+/* up to numnpcs from the templates, fewer if the floor fills */
+static void
+spawn_npcs(unsigned int const numnpcs)
 {
-	uint8_t x, y;
-	size_t retries = 0;
+	ALLOC_PHASE(ALLOC_SPAWN);
 
-	do {
-		x = rr.rrand<uint8_t>(1, WIDTH - 2);
-		y = rr.rrand<uint8_t>(1, HEIGHT - 2);
-		retries++;
-	} while (retries < RETRIES && (!valid_thing(y, x)
-		|| tiles[y][x].o != NULL));
-
-	if (retries == RETRIES) {
-		return {};
+	for (unsigned int j = 0; j < numnpcs; ++j) {
+		std::optional<std::size_t> const pick = spawn_npc_template();
+
+		if (!pick.has_value()) {
+			break;
+		}
+
+		std::size_t const i = *pick;
+
+		std::optional<std::pair<uint8_t, uint8_t>> coords = gen_npc();
+
+		if (!coords.has_value()) {
+			break;
+		}
+
+		npc_id const id = npc_new(npcs_parsed[i]);
+		npc &n = npc_get(id);
+
+		if (n.type & UNIQ) {
+			n.done = true;
+			npcs_parsed[i].done = true;
+		}
+
+		n.x = coords->first;
+		n.y = coords->second;
+
+		tiles[n.y][n.x].n = id;
+	}
+}
+
+static void
+spawn_objs(unsigned int const numobjs)
+{
+	ALLOC_PHASE(ALLOC_SPAWN);
+
+	for (unsigned int j = 0; j < numobjs; ++j) {
+		std::optional<std::size_t> const pick = spawn_obj_template();
+
+		if (!pick.has_value()) {
+			break;
+		}
+
+		std::size_t const i = *pick;
+
+		std::optional<std::pair<uint8_t, uint8_t>> coords = gen_obj();
+
+		if (!coords.has_value()) {
+			break;
+		}
+
+		obj_handle const h = obj_new(objs_parsed[i]);
+		obj &o = obj_get(h);
+
+		if (o.art) {
+			o.done = true;
+			objs_parsed[i].done = true;
+		}
+
+		o.x = coords->first;
+		o.y = coords->second;
+
+		tiles[o.y][o.x].o = h;
 	}
+}
 
-	return std::make_pair(x, y);
+std::optional<std::size_t>
+spawn_npc_template()
+{
+	return pick_template(npcs_parsed);
+}
+
+std::optional<std::size_t>
+spawn_obj_template()
+{
+	return pick_template(objs_parsed);
+}
+
+template<typename T> static std::optional<std::size_t>
+pick_template(std::vector<T> const &parsed)
+{
+	return spawn_pick(parsed,
+		[&parsed](std::size_t const i) { return parsed[i].done; }, rr);
+}
+
+std::optional<std::pair<uint8_t, uint8_t>>
+gen_npc()
+{
+	return spawn_spot(tiles, player.x, player.y,
+		[](uint8_t const y, uint8_t const x) {
+			return tiles[y][x].n != NO_NPC;
+		}, rr);
+}
+
+std::optional<std::pair<uint8_t, uint8_t>>
+gen_obj()
+{
+	return spawn_spot(tiles, player.x, player.y,
+		[](uint8_t const y, uint8_t const x) {
+			return tiles[y][x].o != NO_OBJ;
+		}, rr);
 }
 
 static enum pc_action
-turn_npc(WINDOW *const win, WINDOW *const sep, npc &n)
+turn_npc(npc &n)
 {
 	if (n.type & PLAYER_TYPE) {
-		pc_viewbox(win, DEFAULT_LUMINANCE);
-		return turn_pc(win, sep, n);
+		pc_viewbox(DEFAULT_LUMINANCE);
+		return turn_pc(n);
 	}
 
+	/* after the PC branch, which would count think time */
+	TRACE_SPAN("turn_npc");
+	ALLOC_PHASE(ALLOC_NPC);
+
 	if (n.type & ERRATIC && rr.rrand<int>(0, 1) == 0) {
 		uint8_t y, x;
 
@@ -746,11 +828,13 @@ turn_npc(WINDOW *const win, WINDOW *const sep, npc &n)
 		} while (!(n.type & TUNNEL) && tiles[y][x].h != 0);
 
 		if (n.type & TUNNEL) {
-			move_tunnel(win, n, y, x);
+			move_tunnel(n, y, x);
 		} else {
-			move_logic(win, n, y, x);
+			move_logic(n, y, x);
 		}
 
+		stat_add(STAT_TURN_ERRATIC);
+
 		return PC_NONE;
 	}
 
@@ -762,8 +846,10 @@ turn_npc(WINDOW *const win, WINDOW *const sep, npc &n)
 	case 0x4:
 	case 0xC:
 		/* straight line and tunnel if can see player */
+		stat_add(STAT_TURN_LOS);
+
 		if (pc_visible(n.x, n.y)) {
-			move_straight(win, n);
+			move_straight(n);
 		}
 		break;
 	case 0x2:
@@ -771,19 +857,22 @@ turn_npc(WINDOW *const win, WINDOW *const sep, npc &n)
 	case 0x6:
 	case 0xE:
 		/* straight line and tunnel, telepathic towards player */
-		move_straight(win, n);
+		stat_add(STAT_TURN_TELE);
+		move_straight(n);
 		break;
 	case 0x1:
 	case 0x9:
 	case 0x3:
 	case 0xB:
 		/* nontunneling dijk, remembered location or telepathic */
+		stat_add(STAT_TURN_DIJK);
+
 		if (n.type & TELE || pc_visible(n.x, n.y)) {
 			n.p_count = PERSISTANCE;
 		}
 
 		if (n.p_count != 0) {
-			move_dijk_nontunneling(win, n);
+			move_dijk_nontunneling(n);
 			n.p_count--;
 		}
 		break;
@@ -792,12 +881,14 @@ turn_npc(WINDOW *const win, WINDOW *const sep, npc &n)
 	case 0x7:
 	case 0xF:
 		/* tunneling dijk, remembered location or telepathic */
+		stat_add(STAT_TURN_DIJK_TUNNEL);
+
 		if (n.type & TELE || pc_visible(n.x, n.y)) {
 			n.p_count = PERSISTANCE;
 		}
 
 		if (n.p_count != 0) {
-			move_dijk_tunneling(win, n);
+			move_dijk_tunneling(n);
 			n.p_count--;
 		}
 		break;
@@ -809,15 +900,19 @@ turn_npc(WINDOW *const win, WINDOW *const sep, npc &n)
 }
 
 static enum pc_action
-turn_pc(WINDOW *const win, WINDOW *const sep, npc &n)
+turn_pc(npc &n)
 {
 	uint8_t y = n.y;
 	uint8_t x = n.x;
 	bool exit = false;
 
+	/* show the turn first, so speculating cannot delay the frame */
+	fb_flush();
+	spec_start(n.y, n.x);
+
 	while (!exit) {
 		exit = true;
-		switch(wgetch(win)) {
+		switch(fb_getch()) {
 		case ERR:
 			cerrx(1, "turn_pc wgetch ERR");
 			break;
@@ -887,7 +982,7 @@ turn_pc(WINDOW *const win, WINDOW *const sep, npc &n)
 		case '>':
 			/* go down stairs */
 			if (tiles[y][x].c == STAIR_DN) {
-				return PC_NEXT;
+				return PC_DOWN;
 			} else {
 				exit = false;
 			}
@@ -895,7 +990,7 @@ turn_pc(WINDOW *const win, WINDOW *const sep, npc &n)
 		case '<':
 			/* go up stairs */
 			if (tiles[y][x].c == STAIR_UP) {
-				return PC_NEXT;
+				return PC_UP;
 			} else {
 				exit = false;
 			}
@@ -905,33 +1000,37 @@ turn_pc(WINDOW *const win, WINDOW *const sep, npc &n)
 		case 'Q':
 		case 'q':
 			return PC_QUIT;
+		case 'S':
+			return PC_SAVE;
+		case 'U':
+			return PC_UNDO;
 		case 'f':
 			return PC_DEFOG;
 		case 'g':
 			return PC_TELE;
 		case 'i':
-			carry_list(sep, CARRY_LIST);
+			carry_list(CARRY_LIST);
 			return PC_RETRY;
 		case 'e':
-			equip_list(sep, false);
+			equip_list(false);
 			return PC_RETRY;
 		case 'w':
-			carry_list(sep, CARRY_WEAR);
+			carry_list(CARRY_WEAR);
 			return PC_RETRY;
 		case 't':
-			equip_list(sep, true);
+			equip_list(true);
 			return PC_RETRY;
 		case 'd':
-			carry_list(sep, CARRY_DROP);
+			carry_list(CARRY_DROP);
 			return PC_RETRY;
 		case 'x':
-			carry_list(sep, CARRY_REMOVE);
+			carry_list(CARRY_REMOVE);
 			return PC_RETRY;
 		case 'L':
-			inspect(win, false);
+			inspect(false);
 			return PC_RETRY;
 		case 'I':
-			carry_list(sep, CARRY_INSPECT);
+			carry_list(CARRY_INSPECT);
 			return PC_RETRY;
 		default:
 			exit = false;
@@ -939,59 +1038,60 @@ turn_pc(WINDOW *const win, WINDOW *const sep, npc &n)
 	}
 
 	if (tiles[y][x].h == 0) {
-		move_logic(win, n, y, x);
+		move_logic(n, y, x);
 		try_carry(y, x);
-		dijkstra();
+
+		if (!spec_commit(n.y, n.x)) {
+			dijkstra();
+		}
+	} else {
+		spec_cancel();
 	}
 
 	return PC_NONE;
 }
 
 static void
-npc_list(WINDOW *const nwin, std::vector<npc *> const &npcs)
+npc_list(std::vector<npc> const &npcs)
 {
 	std::vector<npc>::size_type cpos = 0;
 
-	while (1) {
-		if (werase(nwin) == ERR) {
-			cerrx(1, "npc_list erase");
-		}
+	spec_cancel();
+	ALLOC_PHASE(ALLOC_MENU);
 
-		(void)box(nwin, 0, 0);
+	while (1) {
+		fb_erase(FB_MENU);
+		fb_box(FB_MENU, 0);
 
-		(void)mvwprintw(nwin, HEIGHT - 1, 2,
+		fb_print(FB_MENU, HEIGHT - 1, 2, 0,
 			"[ arrow keys to scroll; ESC to exit ]");
 
 		std::size_t i;
 		for (i = 0; i < HEIGHT - 2 && i + cpos < npcs.size(); ++i) {
-			npc *n = npcs[i + cpos];
+			npc const &n = npcs[i + cpos];
 
-			if (n->dead) {
-				(void)mvwprintw(nwin, static_cast<int>(i + 1U),
-					2, "%u.\t'%c'\t(dead)\t\t%s", i + cpos,
-					n->symb, n->name.c_str());
+			if (n.dead) {
+				fb_print(FB_MENU, static_cast<int>(i + 1U), 2,
+					0, "%zu.\t'%c'\t(dead)\t\t%s", i + cpos,
+					n.symb, str_get(n.name).c_str());
 				continue;
 			}
 
-			int dx = player.x - n->x;
-			int dy = player.y - n->y;
+			int dx = player.x - n.x;
+			int dy = player.y - n.y;
 
-			(void)mvwprintw(nwin, static_cast<int>(i + 1U), 2,
-				"%u.\t'%c'\t%d %s and %d %s\t%s", i + cpos,
-				n->symb, abs(dy), dy > 0 ? "north" : "south",
+			fb_print(FB_MENU, static_cast<int>(i + 1U), 2, 0,
+				"%zu.\t'%c'\t%d %s and %d %s\t%s", i + cpos,
+				n.symb, abs(dy), dy > 0 ? "north" : "south",
 				abs(dx), dx > 0 ? "west" : "east",
-				n->name.c_str());
+				str_get(n.name).c_str());
 		}
 
 		for (; i < HEIGHT - 2; ++i) {
-			(void)mvwaddch(nwin, static_cast<int>(i + 1U), 2, '~');
-		}
-
-		if (wrefresh(nwin) == ERR) {
-			cerrx(1, "npc_list wrefresh");
+			fb_put(FB_MENU, static_cast<int>(i + 1U), 2, '~', 0);
 		}
 
-		switch(wgetch(nwin)) {
+		switch(fb_getch()) {
 		case ERR:
 			cerrx(1, "npc_list wgetch ERR");
 			return;
@@ -1014,93 +1114,97 @@ npc_list(WINDOW *const nwin, std::vector<npc *> const &npcs)
 }
 
 static void
-defog(WINDOW *const win)
+defog()
 {
+	spec_cancel();
+
+	fb_erase(FB_MENU);
+	fb_box(FB_MENU, 0);
+
 	for (uint8_t x = 1; x < WIDTH - 1; ++x) {
 		for (uint8_t y = 1; y < HEIGHT - 1; ++y) {
-			npc_obj_or_tile(win, y, x);
+			npc_obj_or_tile(FB_MENU, y, x);
 		}
 	}
 
-	wattron(win, player.color);
-	(void)mvwaddch(win, player.y, player.x, player.symb);
-	wattroff(win, player.color);
+	fb_put(FB_MENU, player.y, player.x, player.symb, player.color);
 
-	(void)mvwprintw(win, HEIGHT - 1, 2, "[ press any key to exit ]");
+	fb_print(FB_MENU, HEIGHT - 1, 2, 0, "[ press any key to exit ]");
 
-	if (wrefresh(win) == ERR) {
-		cerrx(1, "defog wrefresh");
-	}
+	(void)fb_getch();
+}
 
-	(void)wgetch(win);
+/* what the PC remembers of a floor it came back to */
+static void
+redraw_seen()
+{
+	for (uint8_t y = 1; y < HEIGHT - 1; ++y) {
+		for (uint8_t x = 1; x < WIDTH - 1; ++x) {
+			if (tiles[y][x].v) {
+				npc_obj_or_tile(FB_VIEW, y, x);
+			}
+		}
+	}
 }
 
 static void
-crosshair(WINDOW *const win, uint8_t const y, uint8_t const x)
+crosshair(uint8_t const y, uint8_t const x)
 {
 	for (int i = 1; i < HEIGHT - 1; ++i) {
 		if (i != y) {
-			(void)mvwaddch(win, i, x, ACS_VLINE);
+			fb_put(FB_MENU, i, x, G_VLINE, 0);
 		}
 	}
 
 	for (int i = 1; i < WIDTH - 1; ++i) {
 		if (i != x) {
-			(void)mvwaddch(win, y, i, ACS_HLINE);
+			fb_put(FB_MENU, y, i, G_HLINE, 0);
 		}
 	}
 
-	(void)mvwaddch(win, y, 0, ACS_LTEE);
-	(void)mvwaddch(win, y, WIDTH - 1, ACS_RTEE);
-	(void)mvwaddch(win, 0, x, ACS_TTEE);
-	(void)mvwaddch(win, HEIGHT - 1, x, ACS_BTEE);
+	fb_put(FB_MENU, y, 0, G_LTEE, 0);
+	fb_put(FB_MENU, y, WIDTH - 1, G_RTEE, 0);
+	fb_put(FB_MENU, 0, x, G_TTEE, 0);
+	fb_put(FB_MENU, HEIGHT - 1, x, G_BTEE, 0);
 
-	(void)mvwaddch(win, y + 1, x + 0, ACS_TTEE);
-	(void)mvwaddch(win, y - 1, x + 0, ACS_BTEE);
-	(void)mvwaddch(win, y + 0, x - 1, ACS_RTEE);
-	(void)mvwaddch(win, y + 0, x + 1, ACS_LTEE);
+	fb_put(FB_MENU, y + 1, x + 0, G_TTEE, 0);
+	fb_put(FB_MENU, y - 1, x + 0, G_BTEE, 0);
+	fb_put(FB_MENU, y + 0, x - 1, G_RTEE, 0);
+	fb_put(FB_MENU, y + 0, x + 1, G_LTEE, 0);
 
-	(void)mvwaddch(win, y - 1, x - 1, ACS_ULCORNER);
-	(void)mvwaddch(win, y - 1, x + 1, ACS_URCORNER);
-	(void)mvwaddch(win, y + 1, x - 1, ACS_LLCORNER);
-	(void)mvwaddch(win, y + 1, x + 1, ACS_LRCORNER);
+	fb_put(FB_MENU, y - 1, x - 1, G_ULCORNER, 0);
+	fb_put(FB_MENU, y - 1, x + 1, G_URCORNER, 0);
+	fb_put(FB_MENU, y + 1, x - 1, G_LLCORNER, 0);
+	fb_put(FB_MENU, y + 1, x + 1, G_LRCORNER, 0);
 }
 
 static bool
-inspect(WINDOW *const win, bool const teleport)
+inspect(bool const teleport)
 {
-	WINDOW *twin;
 	uint8_t y = player.y;
 	uint8_t x = player.x;
 	bool ret = true;
 
-	while (1) {
-		if ((twin = dupwin(win)) == NULL) {
-			cerrx(1, "inspect dupwin");
-		}
+	spec_cancel();
+	ALLOC_PHASE(ALLOC_MENU);
 
-		if (touchwin(twin) == ERR) {
-			cerrx(1, "inspect touchwin");
-		}
+	while (1) {
+		/* crosshair goes on the menu layer, over the live view */
+		fb_clear(FB_MENU);
 
-		crosshair(twin, y, x);
+		crosshair(y, x);
 
 		if (teleport) {
-			(void)mvwprintw(twin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, 0,
 				"[ PC control keys; 'r' for random location; "
 				"'g' or 't' to teleport; ESC to exit ]");
 		} else {
-			(void)mvwprintw(twin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, 0,
 				"[ PC control keys; 'g' or 't' to inspect; "
 				"ESC to exit ]");
 		}
 
-
-		if (wrefresh(twin) == ERR) {
-			cerrx(1, "inspect wrefresh");
-		}
-
-		switch(wgetch(win)) {
+		switch(fb_getch()) {
 		case ERR:
 			cerrx(1, "inspect wgetch ERR");
 			break;
@@ -1170,15 +1274,15 @@ inspect(WINDOW *const win, bool const teleport)
 			break;
 		case 't':
 		case 'g':
-			if (teleport && tiles[y][x].n == NULL) {
+			if (teleport && tiles[y][x].n == NO_NPC) {
 				/* complete teleport */
 				tiles[y][x].v = true;
-				move_logic(win, player, y, x);
+				move_logic(player, y, x);
 				goto exit;
 			}
 
-			if (!teleport && tiles[y][x].n != NULL) {
-				thing_details(twin, *tiles[y][x].n);
+			if (!teleport && tiles[y][x].n != NO_NPC) {
+				thing_details(npc_get(tiles[y][x].n));
 			}
 
 			break;
@@ -1204,9 +1308,7 @@ inspect(WINDOW *const win, bool const teleport)
 
 	exit:
 
-	if (delwin(twin) == ERR) {
-		cerrx(1, "inspect delwin");
-	}
+	fb_clear(FB_MENU);
 
 	return ret;
 }
@@ -1225,9 +1327,35 @@ viewable(int const y, int const x)
 		|| pc_visible(x + 1, y - 1));
 }
 
-static void
-pc_viewbox(WINDOW *const win, int const lum)
+/* the bag, then the equipment slots */
+void
+pc_items(obj_handle (&items)[PC_ITEMS])
 {
+	std::copy(std::begin(pc_carry), std::end(pc_carry), items);
+
+	for (int i = 0; i < EQUIP_SLOTS; ++i) {
+		items[PC_CARRY_MAX + i] = pc_equip.*equip_slots[i];
+	}
+}
+
+void
+pc_items_set(obj_handle const (&items)[PC_ITEMS])
+{
+	std::copy(items, items + PC_CARRY_MAX, pc_carry);
+
+	for (int i = 0; i < EQUIP_SLOTS; ++i) {
+		pc_equip.*equip_slots[i] = items[PC_CARRY_MAX + i];
+	}
+
+	equip_update();
+}
+
+void
+pc_viewbox(int const lum)
+{
+	TRACE_SPAN("pc_viewbox");
+	ALLOC_PHASE(ALLOC_RENDER);
+
 	uint8_t const start_x = (uint8_t)subu32(player.x + 1, lum);
 	uint8_t const end_x = (uint8_t)(player.x + lum);
 
@@ -1241,7 +1369,7 @@ pc_viewbox(WINDOW *const win, int const lum)
 			}
 
 			tiles[j][i].v = true;
-			npc_obj_or_tile(win, j, i);
+			npc_obj_or_tile(FB_VIEW, j, i);
 		}
 	}
 }
@@ -1249,83 +1377,75 @@ pc_viewbox(WINDOW *const win, int const lum)
 static void
 try_carry(uint8_t const y, uint8_t const x)
 {
-	if (tiles[y][x].o == NULL) {
+	if (tiles[y][x].o == NO_OBJ) {
 		return;
 	}
 
 	for (int i = 0; i < PC_CARRY_MAX; ++i) {
-		if (!pc_carry[i].has_value()) {
-			pc_carry[i] = *tiles[y][x].o;
-			tiles[y][x].o = NULL;
+		if (pc_carry[i] == NO_OBJ) {
+			std::swap(pc_carry[i], tiles[y][x].o);
 			return;
 		}
 	}
 }
 
 static void
-carry_list(WINDOW *const cwin, carry_action const action)
+carry_list(carry_action const action)
 {
 	std::optional<std::string> error;
-	do {
-		if (werase(cwin) == ERR) {
-			cerrx(1, "carry_list erase");
-		}
 
-		if (action == CARRY_REMOVE) {
-			wattron(cwin, COLOR_PAIR(COLOR_RED));
-		}
+	spec_cancel();
+	ALLOC_PHASE(ALLOC_MENU);
+
+	do {
+		int const frame = action == CARRY_REMOVE
+			? COLOR_PAIR(COLOR_RED) : 0;
 
-		(void)box(cwin, 0, 0);
+		fb_erase(FB_MENU);
+		fb_box(FB_MENU, frame);
 
 		switch (action) {
 		case CARRY_DROP:
-			(void)mvwprintw(cwin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, frame,
 				"[ 0-9 to drop, ESC to exit ]");
 			break;
 		case CARRY_INSPECT:
-			(void)mvwprintw(cwin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, frame,
 				"[ 0-9 to inspect, ESC to exit ]");
 			break;
 		case CARRY_REMOVE:
-			(void)mvwprintw(cwin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, frame,
 				"[ 0-9 to REMOVE, ESC to exit ]");
 			break;
 		case CARRY_LIST:
-			(void)mvwprintw(cwin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, frame,
 				"[ press any key to exit ]");
 			break;
 		case CARRY_WEAR:
-			(void)mvwprintw(cwin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, frame,
 				"[ 0-9 to equip, ESC to exit ]");
 			break;
 		}
 
 		if (error.has_value()) {
-			(void)mvwprintw(cwin, 0, 2, "[ error: %s ]",
+			fb_print(FB_MENU, 0, 2, frame, "[ error: %s ]",
 				error->c_str());
 			error.reset();
 		}
 
-		if (action == CARRY_REMOVE) {
-			wattroff(cwin, COLOR_PAIR(COLOR_RED));
-		}
-
-
 		for (int i = 0; i < PC_CARRY_MAX; ++i) {
-			if (pc_carry[i].has_value()) {
-				wattron(cwin, pc_carry[i]->color);
-				(void)mvwprintw(cwin, i + 5, 2,
+			if (pc_carry[i] != NO_OBJ) {
+				obj const &o = obj_get(pc_carry[i]);
+				fb_print(FB_MENU, i + 5, 2, o.color,
 					"%d. %s: \t'%c'\t%s", i,
-					type_map_name[pc_carry[i]->obj_type],
-					pc_carry[i]->symb,
-					pc_carry[i]->name.c_str());
-				wattroff(cwin, pc_carry[i]->color);
+					type_map_name[o.obj_type], o.symb,
+					str_get(o.name).c_str());
 			} else {
-				(void)mvwprintw(cwin, i + 5, 2, "%u.", i);
+				fb_print(FB_MENU, i + 5, 2, 0, "%d.", i);
 			}
 		}
 
-		int const ch = wgetch(cwin);
+		int const ch = fb_getch();
 
 		if (action == CARRY_LIST) {
 			return;
@@ -1349,14 +1469,14 @@ carry_list(WINDOW *const cwin, carry_action const action)
 		case '9':
 			int const i = ch - '0';
 
-			if (!pc_carry[i].has_value()) {
+			if (pc_carry[i] == NO_OBJ) {
 				error = std::string("slot ") + std::to_string(i)
 					+ " has no item";
 				break;
 			}
 
 			if (action == CARRY_WEAR) {
-				if (!type_map_equip[pc_carry[i]->obj_type]) {
+				if (!type_map_equip[obj_get(pc_carry[i]).obj_type]) {
 					error = std::string("item in slot ")
 						+ std::to_string(i)
 						+ " cannot be eqipped";
@@ -1365,12 +1485,18 @@ carry_list(WINDOW *const cwin, carry_action const action)
 
 				carry_to_equip(i);
 			} else if (action == CARRY_DROP) {
-				tiles[player.y][player.x].o = &(*pc_carry[i]);
-				pc_carry[i].reset();
+				if (tiles[player.y][player.x].o != NO_OBJ) {
+					error = "already an item here";
+					break;
+				}
+
+				std::swap(tiles[player.y][player.x].o,
+					pc_carry[i]);
 			} else if (action == CARRY_REMOVE) {
-				pc_carry[i].reset();
+				obj_free(pc_carry[i]);
+				pc_carry[i] = NO_OBJ;
 			} else if (action == CARRY_INSPECT) {
-				thing_details(cwin, *pc_carry[i]);
+				thing_details(obj_get(pc_carry[i]));
 			}
 
 			break;
@@ -1379,25 +1505,24 @@ carry_list(WINDOW *const cwin, carry_action const action)
 }
 
 static void
-print_equipped(WINDOW *const ewin, int const i, char const *const name,
-	char const ch, std::optional<obj> const &item)
+print_equipped(int const i, char const *const name,
+	char const ch, obj_handle const h)
 {
-	if (item.has_value()) {
-		wattron(ewin, item->color);
-		(void)mvwprintw(ewin, i, 2, "%s\t%c.\t'%c'\t%s", name, ch,
-			item->symb, item->name.c_str());
-		wattroff(ewin, item->color);
+	if (h != NO_OBJ) {
+		obj const &item = obj_get(h);
+		fb_print(FB_MENU, i, 2, item.color, "%s\t%c.\t'%c'\t%s", name,
+			ch, item.symb, str_get(item.name).c_str());
 	} else {
-		(void)mvwprintw(ewin, i, 2, "%s\t%c.", name, ch);
+		fb_print(FB_MENU, i, 2, 0, "%s\t%c.", name, ch);
 	}
 }
 
 static void
-equip_list(WINDOW *const ewin, bool const take)
+equip_list(bool const take)
 {
 	std::optional<std::string> error;
 	int const length = 12;
-	std::tuple<std::optional<obj> const *const, char const *const, char> const equip[] = {
+	std::tuple<obj_handle const *const, char const *const, char> const equip[] = {
 		{ &pc_equip.amulet,	"amulet",	'a' },
 		{ &pc_equip.armor,	"armor\t",	'b' },
 		{ &pc_equip.boots,	"boots\t",	'c' },
@@ -1412,33 +1537,33 @@ equip_list(WINDOW *const ewin, bool const take)
 		{ &pc_equip.weapon,	"weapon",	'l' }
 	};
 
-	do {
-		if (werase(ewin) == ERR) {
-			cerrx(1, "equip_list erase");
-		}
+	spec_cancel();
+	ALLOC_PHASE(ALLOC_MENU);
 
-		(void)box(ewin, 0, 0);
+	do {
+		fb_erase(FB_MENU);
+		fb_box(FB_MENU, 0);
 
 		if (take) {
-			(void)mvwprintw(ewin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, 0,
 				"[ a-l to take off, ESC to exit ]");
 		} else {
-			(void)mvwprintw(ewin, HEIGHT - 1, 2,
+			fb_print(FB_MENU, HEIGHT - 1, 2, 0,
 				"[ press any key to exit ]");
 		}
 
 		if (error.has_value()) {
-			(void)mvwprintw(ewin, 0, 2, "[ error: %s ]",
+			fb_print(FB_MENU, 0, 2, 0, "[ error: %s ]",
 				error->c_str());
 			error.reset();
 		}
 
 		for (int i = 0; i < length; ++i) {
-			print_equipped(ewin, i + 4, std::get<1>(equip[i]),
+			print_equipped(i + 4, std::get<1>(equip[i]),
 				std::get<2>(equip[i]), *std::get<0>(equip[i]));
 		}
 
-		int const ch = wgetch(ewin);
+		int const ch = fb_getch();
 
 		if (!take) {
 			return;
@@ -1457,12 +1582,38 @@ equip_list(WINDOW *const ewin, bool const take)
 	} while (1);
 }
 
+/*
+ * Recompute the equipment stats block. Only called when an item is put on or
+ * taken off, so attacks read the aggregate without copying any items.
+ */
+static void
+equip_update()
+{
+	equip_stats &st = pc_equip.stats;
+
+	st = {};
+
+	for (auto const slot : equip_slots) {
+		if (pc_equip.*slot == NO_OBJ) {
+			continue;
+		}
+
+		obj const &item = obj_get(pc_equip.*slot);
+
+		st.dam[st.dam_count++] = item.dam;
+		st.def += item.def;
+		st.dodge += item.dodge;
+		st.hit += item.hit;
+		st.speed += item.speed;
+	}
+}
+
 static void
 carry_to_equip(int const i)
 {
-	std::optional<obj> *equip_slot;
+	obj_handle *equip_slot;
 
-	switch(pc_carry[i]->obj_type) {
+	switch(obj_get(pc_carry[i]).obj_type) {
 	case amulet:
 		equip_slot = &pc_equip.amulet;
 		break;
@@ -1491,7 +1642,7 @@ carry_to_equip(int const i)
 		equip_slot = &pc_equip.ranged;
 		break;
 	case ring:
-		if (pc_equip.ring_right.has_value()) {
+		if (pc_equip.ring_right != NO_OBJ) {
 			equip_slot = &pc_equip.ring_left;
 		} else {
 			equip_slot = &pc_equip.ring_right;
@@ -1505,12 +1656,14 @@ carry_to_equip(int const i)
 	}
 
 	std::swap(pc_carry[i], *equip_slot);
+
+	equip_update();
 }
 
 static void
 equip_to_carry(int const i, std::optional<std::string> &error)
 {
-	std::optional<obj> *equip_slot;
+	obj_handle *equip_slot;
 
 	switch(i) {
 	case 'a':
@@ -1553,13 +1706,14 @@ equip_to_carry(int const i, std::optional<std::string> &error)
 		return;
 	}
 
-	if (!equip_slot->has_value()) {
+	if (*equip_slot == NO_OBJ) {
 		error = std::string("slot ") + (char)i + " has no item";
 	}
 
 	for (int j = 0; j < PC_CARRY_MAX; ++j) {
-		if (!pc_carry[j].has_value()) {
+		if (pc_carry[j] == NO_OBJ) {
 			std::swap(pc_carry[j], *equip_slot);
+			equip_update();
 			return;
 		}
 	}
@@ -1568,16 +1722,16 @@ equip_to_carry(int const i, std::optional<std::string> &error)
 }
 
 static void
-thing_details(WINDOW *const win, dungeon_thing const &d)
+thing_details(dungeon_thing const &d)
 {
-	std::stringstream ss(d.desc);
+	std::stringstream ss(str_get(d.desc));
 	std::string tmp;
 
 	std::vector<std::string> lines;
 	std::vector<std::string>::size_type cpos = 0;
 
 	lines.push_back(std::string("Symbol: '") + (char)d.symb + "'\tName: "
-		+ d.name);
+		+ str_get(d.name));
 	lines.push_back("");
 
 	while (std::getline(ss, tmp, '\n')) {
@@ -1585,30 +1739,23 @@ thing_details(WINDOW *const win, dungeon_thing const &d)
 	}
 
 	while (1) {
-		if (werase(win) == ERR) {
-			cerrx(1, "thing_details erase");
-		}
+		fb_erase(FB_MENU);
+		fb_box(FB_MENU, 0);
 
-		(void)box(win, 0, 0);
-
-		(void)mvwprintw(win, HEIGHT - 1, 2,
+		fb_print(FB_MENU, HEIGHT - 1, 2, 0,
 			"[ arrow keys to scroll; ESC to exit ]");
 
 		std::size_t i;
 		for(i = 0; i < HEIGHT - 2 && i + cpos < lines.size(); ++i) {
-			(void)mvwprintw(win, static_cast<int>(i + 1U), 2,
+			fb_print(FB_MENU, static_cast<int>(i + 1U), 2, 0, "%s",
 				lines[i + cpos].c_str());
 		}
 
 		for (; i < HEIGHT - 2; ++i) {
-			(void)mvwaddch(win, static_cast<int>(i + 1U), 2, '~');
-		}
-
-		if (wrefresh(win) == ERR) {
-			cerrx(1, "thing_details wrefresh");
+			fb_put(FB_MENU, static_cast<int>(i + 1U), 2, '~', 0);
 		}
 
-		switch(wgetch(win)) {
+		switch(fb_getch()) {
 		case ERR:
 			cerrx(1, "thing_details wgetch ERR");
 			return;
@@ -1,16 +1,41 @@
 #ifndef TURN_H
 #define TURN_H
 
-#include <ncurses.h>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "globs.h"
 
 enum turn_exit {
 	TURN_DEATH,
-	TURN_NEXT,
+	TURN_DOWN,
 	TURN_NONE,
 	TURN_QUIT,
+	TURN_UP,
 	TURN_WIN,
 };
 
-enum turn_exit	turn_engine(WINDOW *const, unsigned int const, unsigned int const);
+/* who moves next, a binary heap on turn, soonest on top */
+typedef std::vector<npc_id> npc_heap;
+
+enum turn_exit	turn_engine(unsigned int const, unsigned int const);
+
+/* what the PC carries and wears, NO_OBJ where empty, for snapshots */
+std::size_t constexpr PC_ITEMS = 22;
+
+void	pc_items(obj_handle (&)[PC_ITEMS]);
+void	pc_items_set(obj_handle const (&)[PC_ITEMS]);
+
+/* pieces of a turn, also timed by the microbenchmarks */
+void	pc_viewbox(int const);
+
+std::optional<std::size_t>	spawn_npc_template();
+std::optional<std::size_t>	spawn_obj_template();
+
+std::optional<std::pair<uint8_t, uint8_t>>	gen_npc();
+std::optional<std::pair<uint8_t, uint8_t>>	gen_obj();
 
 #endif /* TURN_H */